@@ -1,7 +1,8 @@
 #include "animations.h"
+#include "fixmath.h"
 #include "ledterne.h"
 
-#include <stdlib.h>
+#include <avr/pgmspace.h>
 #include <string.h>
 
 
@@ -21,28 +22,10 @@ uint8_t rampUp( uint8_t* value, uint8_t maxValue, uint8_t stepSize )
 }
 
 
-struct _RampUpDownAnimation
+void RampUpDown_init( RampUpDownAnimation* ani, uint8_t maxValue, uint8_t up )
 {
-	uint8_t maxValue;
-	uint8_t up;
-};
-
-RampUpDownAnimation* RampUpDown_create( uint8_t maxValue, uint8_t up )
-{
-	RampUpDownAnimation* ani = (RampUpDownAnimation*) malloc( sizeof( RampUpDownAnimation ) );
-
-	if( ani )
-	{
-		ani->maxValue = maxValue;
-		ani->up       = up;
-	}
-
-	return ani;
-}
-
-void RampUpDown_destroy( RampUpDownAnimation* ani )
-{
-	free( ani );
+	ani->maxValue = maxValue;
+	ani->up       = up;
 }
 
 // return 1 if one complete cycle (first up, then down) has been completed
@@ -87,45 +70,9 @@ uint8_t RampUpDown_step( RampUpDownAnimation* ani, uint8_t* value, uint8_t stepS
 }
 
 
-struct _MixedColorBlendingProgram
-{
-	RampUpDownAnimation* aniR;
-	RampUpDownAnimation* aniG;
-	RampUpDownAnimation* aniB;
-	uint8_t r;
-	uint8_t g;
-	uint8_t b;
-	uint8_t frame;
-};
-
-MixedColorBlendingProgram* MixedColorBlending_create()
-{
-	MixedColorBlendingProgram* prog
-		= (MixedColorBlendingProgram*) malloc( sizeof( MixedColorBlendingProgram ) );
-
-	if( prog )
-	{
-		prog->aniR = RampUpDown_create( MAX_INTENSITY, 1 );
-		prog->aniG = RampUpDown_create( MAX_INTENSITY, 1 );
-		prog->aniB = RampUpDown_create( MAX_INTENSITY, 1 );
-
-		// intial LED intensities
-		prog->r =  0;
-		prog->g = 10;
-		prog->b = 21;
-
-		prog->frame = 0;
-	}
-
-	return prog;
-}
-
-void MixedColorBlending_destroy( MixedColorBlendingProgram* prog )
+void MixedColorBlending_init( MixedColorBlendingProgram* prog )
 {
-	RampUpDown_destroy( prog->aniR );
-	RampUpDown_destroy( prog->aniG );
-	RampUpDown_destroy( prog->aniB );
-	free( prog );
+	CR_INIT( prog->cr );
 }
 
 uint8_t MixedColorBlending_execute( MixedColorBlendingProgram* prog )
@@ -136,82 +83,59 @@ uint8_t MixedColorBlending_execute( MixedColorBlendingProgram* prog )
 
 	uint8_t i;
 
-	// update LED colors for display
-	for( i = 0; i < NUM_PIXELS; i++ )
-	{
-		setIntensity( i, prog->r, prog->g, prog->b );
-	}
-
-	// advance color animation one step
-	RampUpDown_step( prog->aniR, &prog->r, 2 );
-	RampUpDown_step( prog->aniG, &prog->g, 1 );
-	RampUpDown_step( prog->aniB, &prog->b, 3 );
+	CR_BEGIN( prog->cr );
 
-	// advance frame counter (automatically wraps around)
-	return rampUp( &prog->frame, programLen - 1, 1 );
-}
+	RampUpDown_init( &prog->aniR, MAX_INTENSITY, 1 );
+	RampUpDown_init( &prog->aniG, MAX_INTENSITY, 1 );
+	RampUpDown_init( &prog->aniB, MAX_INTENSITY, 1 );
 
+	// intial LED intensities
+	prog->r =  0;
+	prog->g = 10;
+	prog->b = 21;
 
-struct _KnightRiderProgram
-{
-	RampUpDownAnimation* ramp;
-	uint8_t centerIndex;
-	uint8_t frame;
-	uint8_t fadeState[ NUM_PIXELS ];
-};
+	while( 1 )
+	{
+		for( prog->frame = 0; prog->frame < programLen; prog->frame++ )
+		{
+			// update LED colors for display
+			for( i = 0; i < NUM_PIXELS; i++ )
+			{
+				setPixel( i, prog->r, prog->g, prog->b );
+			}
 
-KnightRiderProgram* KnightRider_create()
-{
-	KnightRiderProgram* prog = (KnightRiderProgram*) malloc( sizeof( KnightRiderProgram ) );
+			// advance color animation one step
+			RampUpDown_step( &prog->aniR, &prog->r, 2 );
+			RampUpDown_step( &prog->aniG, &prog->g, 1 );
+			RampUpDown_step( &prog->aniB, &prog->b, 3 );
 
-	if( prog )
-	{
-		prog->ramp = RampUpDown_create( NUM_PIXELS - 1, 1 );
-		prog->centerIndex = 0;
-		prog->frame = 0;
-		memset( prog->fadeState, 0, sizeof( prog->fadeState ) );
+			CR_YIELD( prog->cr, prog->frame == programLen - 1 );
+		}
 	}
 
-	return prog;
+	CR_END( prog->cr );
 }
 
-void KnightRider_destroy( KnightRiderProgram* prog )
-{
-	RampUpDown_destroy( prog->ramp );
-	free( prog );
-}
 
-/**
- * The basic idea is this: Let a pixel (called "center pixel") bounce back and forth using an
- * up/down ramp animation which determines the current center position. This center pixel is always
- * at maximum brightness while the other pixels slowly fade from their previous brightness down to
- * zero brightness. Since being the current center pixel is the only way to light up an unlit pixel,
- * the center pixel will automatically drag a tail of fading pixels behind it.
- *
- * The actual program is a couple of frames longer than the actual animation of the moving center
- * pixel. This will create a short pause in the bouncing and fading animation in which the LEDs can
- * fade to zero and remain completely off for a couple of frames before the next iteration starts.
- */
-uint8_t KnightRider_execute( KnightRiderProgram* prog )
-{
-	#define NUM_FADE_STATES 4
-	#define PROGRAM_TOTAL_LEN 25     // total number of frames in this program
-	#define PROGRAM_MOVEMENT_LEN 17  // number of frames that the moving center pixel is animated
+#define NUM_FADE_STATES 4
 
-	static uint8_t fadeIntensities[ NUM_FADE_STATES ] =
+// show one frame of the KnightRider program (no center pixel if centerIndex >= NUM_PIXELS)
+static void KnightRider_draw( KnightRiderProgram* prog, uint8_t centerIndex )
+{
+	// intensities of the fade states (fractions of MAX_INTENSITY, 255 = 1)
+	static uint8_t const fadeIntensities[ NUM_FADE_STATES ] PROGMEM =
 	{
-		0.000 * MAX_INTENSITY,
-		0.162 * MAX_INTENSITY,
-		0.710 * MAX_INTENSITY,
-		1.000 * MAX_INTENSITY,
+		  0, // 0.000
+		 41, // 0.162
+		181, // 0.710
+		255, // 1.000
 	};
 
-	uint8_t lightCenterPixel = prog->frame < PROGRAM_MOVEMENT_LEN;
 	uint8_t i;
 
 	for( i = 0; i < NUM_PIXELS; i++ )
 	{
-		if( lightCenterPixel && ( i == prog->centerIndex ) )
+		if( i == centerIndex )
 		{
 			// switch on the current center pixel
 			prog->fadeState[ i ] = NUM_FADE_STATES - 1;
@@ -226,211 +150,374 @@ uint8_t KnightRider_execute( KnightRiderProgram* prog )
 		}
 
 		// make LEDs light up red only
-		setIntensity( i, fadeIntensities[ prog->fadeState[ i ] ], 0, 0 );
+		uint8_t fade = pgm_read_byte( &fadeIntensities[ prog->fadeState[ i ] ] );
+		setPixel( i, fxScale( MAX_INTENSITY, fade ), 0, 0 );
 	}
+}
 
-	// advance center position one step
-	RampUpDown_step( prog->ramp, &prog->centerIndex, 1 );
+void KnightRider_init( KnightRiderProgram* prog )
+{
+	CR_INIT( prog->cr );
+}
 
-	if( prog->frame < PROGRAM_TOTAL_LEN )
-	{
-		prog->frame += 1;
-		return 0;
-	}
-	else
+/**
+ * The basic idea is this: Let a pixel (called "center pixel") bounce back and forth. This center
+ * pixel is always at maximum brightness while the other pixels slowly fade from their previous
+ * brightness down to zero brightness. Since being the current center pixel is the only way to light
+ * up an unlit pixel, the center pixel will automatically drag a tail of fading pixels behind it.
+ *
+ * After the center pixel has bounced back and forth twice, there is a short pause in which the LEDs
+ * can fade to zero and remain completely off for a couple of frames before the next iteration
+ * starts.
+ */
+uint8_t KnightRider_execute( KnightRiderProgram* prog )
+{
+	#define NUM_BOUNCES 2
+	#define PAUSE_LEN 9  // number of frames without center pixel at the end of the program
+
+	CR_BEGIN( prog->cr );
+
+	memset( prog->fadeState, 0, sizeof( prog->fadeState ) );
+
+	while( 1 )
 	{
-		prog->frame = 0;
 		prog->centerIndex = 0;
 
-		// NOTE: If we want to be really tidy, we should reset the ramp and the fade states here to
-		//       allow for arbitrary program lengths and animations lengths.
+		for( prog->n = 0; prog->n < NUM_BOUNCES; prog->n++ )
+		{
+			for( ; prog->centerIndex < NUM_PIXELS - 1; prog->centerIndex++ )
+			{
+				KnightRider_draw( prog, prog->centerIndex );
+				CR_YIELD( prog->cr, 0 );
+			}
 
-		return 1;
+			for( ; prog->centerIndex > 0; prog->centerIndex-- )
+			{
+				KnightRider_draw( prog, prog->centerIndex );
+				CR_YIELD( prog->cr, 0 );
+			}
+		}
+
+		// final position of the center pixel
+		KnightRider_draw( prog, 0 );
+		CR_YIELD( prog->cr, 0 );
+
+		for( prog->n = 0; prog->n < PAUSE_LEN; prog->n++ )
+		{
+			KnightRider_draw( prog, NUM_PIXELS );
+			CR_YIELD( prog->cr, prog->n == PAUSE_LEN - 1 );
+		}
 	}
+
+	CR_END( prog->cr );
 }
 
 
-struct _ColoredConveyorProgram
+void ColoredConveyor_init( ColoredConveyorProgram* prog )
 {
-	RampUpDownAnimation* ramps[ NUM_PIXELS ];
-	uint8_t r[ NUM_PIXELS ];
-	uint8_t g[ NUM_PIXELS ];
-	uint8_t b[ NUM_PIXELS ];
-	uint8_t* p[ NUM_PIXELS ];
-	uint8_t* colorList[ 3 ];
-	uint8_t colorIndex[ NUM_PIXELS ];
-	uint8_t frame;
-	uint8_t cyclesToGo[ NUM_PIXELS ];
-	uint8_t init[ NUM_PIXELS ];
-};
-
-uint8_t triangle( uint8_t x )
+	CR_INIT( prog->cr );
+}
+
+/**
+ * Each pixel ramps one color up and down (triangle wave), all pixels with a different phase. After
+ * a pixel has completed CYCLES_PER_COLOR triangle cycles, it switches to the next color (red, green,
+ * blue, red, ...). A cycle is completed when the intensity reaches zero.
+ */
+uint8_t ColoredConveyor_execute( ColoredConveyorProgram* prog )
 {
-	uint8_t p = MAX_INTENSITY;
+	#define TRIANGLE_PERIOD ( 2 * MAX_INTENSITY )
+	#define CYCLES_PER_COLOR 4
 
-#if 0
-	return p - abs( ( x % ( 2*p ) ) - p );
-#else
-	uint8_t T = 2*p;
+	uint8_t i;
 
-	// This is x % T but makes GCC use a faster intrinsic for the division.
-	uint8_t x_ = x - T * ( x / T );
+	CR_BEGIN( prog->cr );
 
-	if( x_ < p )
-	{
-		return x_;
-	}
-	else
+	for( i = 0; i < NUM_PIXELS; i++ )
 	{
-		return T - x_;
-	}
-#endif
-}
+		// distribute the pixels evenly over the triangle period (rounded to nearest)
+		uint8_t phase = ( 2 * i * ( TRIANGLE_PERIOD + 1 ) + NUM_PIXELS ) / ( 2 * NUM_PIXELS );
 
-ColoredConveyorProgram* ColoredConveyor_create()
-{
-	ColoredConveyorProgram* prog
-		= (ColoredConveyorProgram*) malloc( sizeof( ColoredConveyorProgram ) );
+		// A pixel with phase 0 starts at zero intensity, i.e. it has completed a cycle in the very
+		// first frame. This is the same as starting one period later.
+		prog->phase[ i ] = phase > 0 ? phase : TRIANGLE_PERIOD;
+	}
 
-	if( prog )
+	while( 1 )
 	{
-		uint8_t i;
-
-		for( i = 0; i < NUM_PIXELS; i++ )
+		for( prog->cycle = 0; prog->cycle < 3 * CYCLES_PER_COLOR; prog->cycle++ )
 		{
-			// initial LED intensities
-			// TODO: GCC does not compute these constants at compile-time and thus avoid
-			//       floating-point math. How can we force it to do so? So far, only compiling with
-			//       -03 seems to do the job.
-			uint8_t d = 0.5f + i * ( 2.f * MAX_INTENSITY + 1 ) / NUM_PIXELS;
-			prog->init[ i ] = d;
-			prog->r[ i ] = triangle( d );
-			prog->g[ i ] = 0;
-			prog->b[ i ] = 0;
-
-			prog->colorIndex[ i ] = 0;
+			for( prog->frame = 0; prog->frame < TRIANGLE_PERIOD; prog->frame++ )
+			{
+				for( i = 0; i < NUM_PIXELS; i++ )
+				{
+					// position on the triangle wave and number of cycles completed by this pixel
+					uint8_t x = prog->phase[ i ] + prog->frame;
+					uint8_t cycle = prog->cycle;
 
-			prog->p[ i ] = &prog->r[ i ];
+					if( x >= TRIANGLE_PERIOD )
+					{
+						x -= TRIANGLE_PERIOD;
+						cycle = cycle < 3 * CYCLES_PER_COLOR - 1 ? cycle + 1 : 0;
+					}
 
-			prog->cyclesToGo[ i ] = 4;
-		}
+					uint8_t v = fxTriangle( x, MAX_INTENSITY );
+					uint8_t color = cycle / CYCLES_PER_COLOR;
 
-		prog->colorList[ 0 ] = prog->r;
-		prog->colorList[ 1 ] = prog->g;
-		prog->colorList[ 2 ] = prog->b;
+					setPixel( i, color == 0 ? v : 0, color == 1 ? v : 0, color == 2 ? v : 0 );
+				}
 
-		prog->frame = 0;
+				CR_YIELD( prog->cr, prog->frame == TRIANGLE_PERIOD - 1 );
+			}
+		}
 	}
 
-	return prog;
+	CR_END( prog->cr );
 }
 
-void ColoredConveyor_destroy( ColoredConveyorProgram* prog )
+
+void TestDisplays_init( TestDisplaysProgram* prog )
 {
-	free( prog );
+	CR_INIT( prog->cr );
 }
 
-uint8_t ColoredConveyor_execute( ColoredConveyorProgram* prog )
+uint8_t TestDisplays_execute( TestDisplaysProgram* prog )
 {
 	uint8_t i;
 
-	for( i = 0; i < NUM_PIXELS; i++ )
+	CR_BEGIN( prog->cr );
+
+	while( 1 )
 	{
-		// ramp up/down the colors pointed to by p
-		*( prog->p[ i ] ) = triangle( prog->init[ i ] + prog->frame );
-		if( *( prog->p[ i ] ) == 0 )
+		// 0 - red, 1 - green, 2 - blue
+		for( prog->color = 0; prog->color < 3; prog->color++ )
 		{
-			prog->cyclesToGo[ i ] -= 1;
-			if( prog->cyclesToGo[ i ] == 0 )
+			for( prog->centerIndex = 0; prog->centerIndex < NUM_PIXELS; prog->centerIndex++ )
 			{
-				// if the configured number of triangle cycles has been completed, select the next
-				// color (start at beginning if we reached the color list's end)
-				rampUp( &prog->colorIndex[ i ], 2, 1 );
-
-				uint8_t currentColorIndex = prog->colorIndex[ i ];
-				prog->p[ i ] = &( prog->colorList[ currentColorIndex ][ i ] );
-
-				prog->cyclesToGo[ i ] = 4;
+				for( i = 0; i < NUM_PIXELS; i++ )
+				{
+					uint8_t red = 0, green = 0, blue = 0;
+					if ( i == prog->centerIndex )
+					{
+						switch( prog->color )
+						{
+							case 0:
+								red = MAX_INTENSITY;
+								break;
+							case 1:
+								green = MAX_INTENSITY;
+								break;
+							case 2:
+								blue = MAX_INTENSITY;
+								break;
+						}
+					}
+
+					setPixel( i, red, green, blue );
+				}
+
+				// program length has been reached after each LED has been lit in each color
+				CR_YIELD( prog->cr, prog->color == 2 && prog->centerIndex == NUM_PIXELS - 1 );
 			}
 		}
 	}
 
-	// update LED colors for display
+	CR_END( prog->cr );
+}
+
+
+void Rainbow_init( RainbowProgram* prog )
+{
+	prog->hue = 0;
+}
+
+/**
+ * The pixels show the colors of the color wheel, spread evenly over the whole wheel, and the wheel
+ * turns once per 256 << RAINBOW_TURN_SHIFT ms (whatever the frame period is). The program has
+ * finished after a complete turn.
+ */
+uint8_t Rainbow_execute( RainbowProgram* prog )
+{
+	#define RAINBOW_TURN_SHIFT 4 // ca. 4 s per turn
+
+	// The time wraps around after 16 turns, so the wheel keeps turning smoothly. Hue of the current
+	// pixel, with 8 fractional bits.
+	uint8_t firstHue = animationTime() >> RAINBOW_TURN_SHIFT;
+	uint16_t hue = firstHue << 8;
+	uint8_t rgb[ 3 ];
+	uint8_t i;
+
 	for( i = 0; i < NUM_PIXELS; i++ )
 	{
-		setIntensity( i, prog->r[ i ], prog->g[ i ], prog->b[ i ] );
+		fxHsv( hue >> 8, 255, MAX_INTENSITY, rgb );
+		setPixel( i, rgb[ 0 ], rgb[ 1 ], rgb[ 2 ] );
+
+		hue += 65536UL / NUM_PIXELS;
 	}
 
-	// advance frame counter (automatically wraps around)
-	return rampUp( &prog->frame, 2 * MAX_INTENSITY - 1, 1 );
+	// the hue of the first pixel has wrapped around
+	uint8_t finished = firstHue < prog->hue;
+
+	prog->hue = firstHue;
+
+	return finished;
 }
 
 
-struct _TestDisplaysProgram
+void CandleFlicker_init( CandleFlickerProgram* prog )
 {
-	uint8_t frame;
-	uint8_t color;       // 0 - red, 1 - green, 2 - blue
-	uint8_t centerIndex; // Currently lit LED.
-};
+	// the same flames every time (the golden output of the host build relies on this)
+	uint16_t seed = 0xace1;
+	uint8_t i;
+
+	prog->time = 0;
+	prog->glowFraction = 0;
+	prog->flickerFraction = 0;
+
+	for( i = 0; i < NUM_PIXELS; i++ )
+	{
+		fxNoiseInit( &prog->glow[ i ], fxRandom( &seed ) );
+		fxNoiseInit( &prog->flicker[ i ], fxRandom( &seed ) );
+	}
+}
 
-TestDisplaysProgram* TestDisplays_create()
+/**
+ * Each pixel is a candle flame: orange light whose brightness is the sum of two smoothed noises, a
+ * slow one for the glow and a fast one for the flicker, and which turns more yellow the brighter it
+ * is. The noises advance with the time since the last frame, so they change at the same speed at
+ * any frame period (but the flicker looks choppy at frame periods above ca. 20 ms). The program has
+ * finished after 1 << CANDLE_RUN_SHIFT ms.
+ */
+uint8_t CandleFlicker_execute( CandleFlickerProgram* prog )
 {
-	TestDisplaysProgram* prog = (TestDisplaysProgram*) malloc( sizeof(TestDisplaysProgram) );
+	#define CANDLE_RUN_SHIFT 13     // ca. 8 s per run
+	#define CANDLE_GLOW_RATE 29     // noise steps per 64 ms: new glow level every ca. 560 ms
+	#define CANDLE_FLICKER_RATE 170 // new flicker level every ca. 100 ms
 
-	prog->frame       = 0;
-	prog->color       = 0;
-	prog->centerIndex = 0;
+	uint16_t time = animationTime();
+	uint16_t elapsed = time - prog->time;
 
-	return prog;
+	// after long pauses, the noises simply continue
+	if( elapsed > 255 )
+	{
+		elapsed = 255;
+	}
+
+	uint16_t glowSteps = prog->glowFraction + elapsed * CANDLE_GLOW_RATE;
+	uint16_t flickerSteps = prog->flickerFraction + elapsed * CANDLE_FLICKER_RATE;
+
+	prog->glowFraction = glowSteps & 63;
+	prog->flickerFraction = flickerSteps & 63;
+	glowSteps >>= 6;
+	flickerSteps >>= 6;
+
+	// more than one lattice point per frame is the same as one
+	uint8_t flickerStep = flickerSteps < 256 ? flickerSteps : 255;
+	uint8_t i;
+
+	for( i = 0; i < NUM_PIXELS; i++ )
+	{
+		uint8_t glow = fxNoise( &prog->glow[ i ], glowSteps );
+		uint8_t flicker = fxNoise( &prog->flicker[ i ], flickerStep );
+
+		// 1/8 at the least, so the flame never goes out
+		uint8_t level = 32 + ( glow >> 1 ) + ( flicker >> 2 ) + ( flicker >> 3 );
+		uint8_t r = fxScale( MAX_INTENSITY, level );
+
+		setPixel( i, r, fxScale( r, 64 + ( level >> 2 ) ), 0 );
+	}
+
+	// the time has passed the end of a run (it wraps around after 8 runs)
+	uint8_t finished = ( ( time ^ prog->time ) >> CANDLE_RUN_SHIFT ) != 0;
+
+	prog->time = time;
+
+	return finished;
 }
 
-void TestDisplays_destroy( TestDisplaysProgram* prog )
+
+void Stream_init( StreamProgram* prog, uint8_t const* stream )
 {
-	free( prog );
+	memset( prog, 0, sizeof( *prog ) );
+	prog->stream = stream;
+	prog->pos    = stream;
 }
 
-uint8_t TestDisplays_execute( TestDisplaysProgram* prog )
+uint8_t Stream_execute( StreamProgram* prog )
 {
-	const uint8_t PROGRAM_LEN = 15;
-
+	uint8_t ch = 0;
 	uint8_t i;
 
-	for( i = 0; i < NUM_PIXELS; i++ )
+	// decode the next frame
+	while( 1 )
 	{
-		uint8_t red = 0, green = 0, blue = 0;
-		if ( i == prog->centerIndex )
+		// unchanged channels (possibly left over from the previous frame)
+		uint8_t n = STREAM_FRAME_SIZE - ch;
+		if( prog->skip < n )
 		{
-			switch( prog->color )
-			{
-				case 0:
-					red = MAX_INTENSITY;
-					break;
-				case 1:
-					green = MAX_INTENSITY;
-					break;
-				case 2:
-					blue = MAX_INTENSITY;
-					break;
-			}
+			n = prog->skip;
 		}
 
-		setIntensity( i, red, green, blue );		
-	}
+		ch += n;
+		prog->skip -= n;
+
+		if( ch == STREAM_FRAME_SIZE )
+		{
+			break;
+		}
+
+		uint8_t token = pgm_read_byte( prog->pos++ );
+		uint8_t arg = token & 0x3f;
 
+		switch( token & 0xc0 )
+		{
+			case STREAM_LITERAL:
+				prog->frame[ ch++ ] = arg;
+				break;
+
+			case STREAM_SKIP:
+				prog->skip = arg + 1;
+				break;
+
+			case STREAM_DELTA:
+				n = arg >> 3;
+				prog->frame[ ch++ ] += n < 4 ? n + 1 : 3 - n;
+				prog->skip = arg & 7;
+				break;
+
+			case STREAM_COPY:
+				for( n = arg + 1; n > 0; n-- )
+				{
+					prog->frame[ ch ] = prog->frame[ ch - 3 ];
+					ch += 1;
+				}
+				break;
+		}
+	}
 
-	prog->centerIndex += 1; // Avoid modulo!?!
-	if ( prog->centerIndex >= NUM_PIXELS )
+	for( i = 0; i < NUM_PIXELS; i++ )
 	{
-		prog->centerIndex = 0;
-		prog->color += 1;
-		
-		if ( prog->color >= 3 ) 
-			prog->color = 0;
+		setPixel( i, prog->frame[ 3 * i + 0 ], prog->frame[ 3 * i + 1 ], prog->frame[ 3 * i + 2 ] );
 	}
 
-	prog->frame += 1;
-	return prog->frame >= PROGRAM_LEN; // 1 - if program length has been reached, otherwise 0
-}
+	// markers behind the frame (the encoder never lets a skip run across them)
+	uint8_t finished = 0;
 
+	if( prog->skip == 0 )
+	{
+		uint8_t token = pgm_read_byte( prog->pos );
 
+		if( token == STREAM_END_RUN )
+		{
+			finished = 1;
+			token = pgm_read_byte( ++prog->pos );
+		}
 
+		if( token == STREAM_END_STREAM )
+		{
+			prog->pos = prog->stream;
+			memset( prog->frame, 0, sizeof( prog->frame ) );
+		}
+	}
+
+	return finished;
+}
@@ -1,6 +1,11 @@
 #ifndef ANIMATIONS_H_
 #define ANIMATIONS_H_
 
+#include "coroutine.h"
+#include "fixmath.h"
+#include "ledterne.h"
+#include "script.h"
+
 #include <inttypes.h>
 
 
@@ -9,14 +14,22 @@ enum AnimationProgram
 	MixedColorBlending,
 	KnightRider,
 	ColoredConveyor,
-	TestDisplays
+	TestDisplays,
+	Rainbow,
+	CandleFlicker,
+	Script,      // keyframe script (see script.h)
+	Stream,      // pre-rendered frame stream (see StreamProgram)
+	Serial       // frames sent by the PC over the USART (see serial.h)
 };
 
 typedef struct
 {
 	enum AnimationProgram programType;
+	uint8_t const* data; // script or frame stream (in flash) for programType Script and Stream
 	uint8_t repetitions;
-	uint16_t timerPeriod;
+	uint16_t framePeriod; // ms, the duration of a step of the program (unless timeBased)
+	uint8_t timeBased;    // the program draws the frame of the current time (e.g. from
+	                      // animationTime()) instead of advancing one step per framePeriod
 }
 AnimationModule;
 
@@ -24,45 +37,153 @@ AnimationModule;
 uint8_t rampUp( uint8_t* value, uint8_t maxValue, uint8_t stepSize );
 
 
-struct _RampUpDownAnimation;
-typedef struct _RampUpDownAnimation RampUpDownAnimation;
+typedef struct _RampUpDownAnimation
+{
+	uint8_t maxValue;
+	uint8_t up;
+}
+RampUpDownAnimation;
 
-RampUpDownAnimation* RampUpDown_create( uint8_t maxValue, uint8_t up );
-void RampUpDown_destroy( RampUpDownAnimation* ani );
+void RampUpDown_init( RampUpDownAnimation* ani, uint8_t maxValue, uint8_t up );
 uint8_t RampUpDown_step( RampUpDownAnimation* ani, uint8_t* value, uint8_t stepSize );
 
 
-struct _MixedColorBlendingProgram;
-typedef struct _MixedColorBlendingProgram MixedColorBlendingProgram;
+typedef struct _MixedColorBlendingProgram
+{
+	coroutine_t cr;
+	RampUpDownAnimation aniR;
+	RampUpDownAnimation aniG;
+	RampUpDownAnimation aniB;
+	uint8_t r;
+	uint8_t g;
+	uint8_t b;
+	uint8_t frame;
+}
+MixedColorBlendingProgram;
 
-MixedColorBlendingProgram* MixedColorBlending_create();
-void MixedColorBlending_destroy( MixedColorBlendingProgram* prog );
+void MixedColorBlending_init( MixedColorBlendingProgram* prog );
 uint8_t MixedColorBlending_execute( MixedColorBlendingProgram* prog );
 
 
-struct _KnightRiderProgram;
-typedef struct _KnightRiderProgram KnightRiderProgram;
+typedef struct _KnightRiderProgram
+{
+	coroutine_t cr;
+	uint8_t centerIndex;
+	uint8_t n;
+	uint8_t fadeState[ NUM_PIXELS ];
+}
+KnightRiderProgram;
 
-KnightRiderProgram* KnightRider_create();
-void KnightRider_destroy( KnightRiderProgram* prog );
+void KnightRider_init( KnightRiderProgram* prog );
 uint8_t KnightRider_execute( KnightRiderProgram* prog );
 
 
-struct _ColoredConveyorProgram;
-typedef struct _ColoredConveyorProgram ColoredConveyorProgram;
+typedef struct _ColoredConveyorProgram
+{
+	coroutine_t cr;
+	uint8_t cycle;
+	uint8_t frame;
+	uint8_t phase[ NUM_PIXELS ];
+}
+ColoredConveyorProgram;
 
-ColoredConveyorProgram* ColoredConveyor_create();
-void ColoredConveyor_destroy( ColoredConveyorProgram* prog );
+void ColoredConveyor_init( ColoredConveyorProgram* prog );
 uint8_t ColoredConveyor_execute( ColoredConveyorProgram* prog );
 
 
-struct _TestDisplaysProgram;
-typedef struct _TestDisplaysProgram TestDisplaysProgram;
+typedef struct _TestDisplaysProgram
+{
+	coroutine_t cr;
+	uint8_t color;       // 0 - red, 1 - green, 2 - blue
+	uint8_t centerIndex; // Currently lit LED.
+}
+TestDisplaysProgram;
 
-TestDisplaysProgram* TestDisplays_create();
-void TestDisplays_destroy( TestDisplaysProgram* prog );
+void TestDisplays_init( TestDisplaysProgram* prog );
 uint8_t TestDisplays_execute( TestDisplaysProgram* prog );
 
 
-#endif // ANIMATIONS_H_
+typedef struct _RainbowProgram
+{
+	uint8_t hue; // of the first pixel in the last frame
+}
+RainbowProgram;
 
+void Rainbow_init( RainbowProgram* prog );
+uint8_t Rainbow_execute( RainbowProgram* prog );
+
+
+typedef struct _CandleFlickerProgram
+{
+	uint16_t time; // animationTime() of the last frame
+	uint8_t glowFraction;    // fractional noise steps left over from the last frame (1/64)
+	uint8_t flickerFraction;
+	fxNoise_t glow[ NUM_PIXELS ];    // slow changes of the brightness
+	fxNoise_t flicker[ NUM_PIXELS ]; // fast ones
+}
+CandleFlickerProgram;
+
+void CandleFlicker_init( CandleFlickerProgram* prog );
+uint8_t CandleFlicker_execute( CandleFlickerProgram* prog );
+
+
+/**
+ * Player for pre-rendered frame streams
+ *
+ * The frames of any program can be rendered on the PC and stored in flash as a compressed stream
+ * of delta frames (see tools/prerender.c and the Makefile), which is then played back at a small,
+ * constant cost per frame instead of computing the frames on the chip. A stream is a sequence of
+ * one byte tokens, each of which updates the next channel(s) of the frame (NUM_PIXELS * 3 LED
+ * intensities in pixel order: r, g, b, r, ...) relative to the previous frame:
+ *
+ *     00vvvvvv  literal: set the next channel to v
+ *     01nnnnnn  skip: leave the next n + 1 channels unchanged (may span several frames)
+ *     10dddnnn  delta: add d + 1 (d < 4) or 3 - d (d >= 4) to the next channel, then skip n
+ *               channels
+ *     11nnnnnn  copy: set the next n + 1 channels to the ones of the previous pixel
+ *     11111110  end of a run (the program has finished with the previous frame)
+ *     11111111  end of the stream: start again at the beginning
+ *
+ * The first frame of the stream is relative to a black frame.
+ */
+
+#define STREAM_FRAME_SIZE ( 3 * NUM_PIXELS )
+
+#define STREAM_LITERAL    0x00
+#define STREAM_SKIP       0x40
+#define STREAM_DELTA      0x80
+#define STREAM_COPY       0xc0
+#define STREAM_END_RUN    0xfe
+#define STREAM_END_STREAM 0xff
+
+typedef struct _StreamProgram
+{
+	uint8_t const* stream; // in flash
+	uint8_t const* pos;    // next token
+	uint8_t skip;          // number of channels still to be skipped
+	uint8_t frame[ STREAM_FRAME_SIZE ];
+}
+StreamProgram;
+
+void Stream_init( StreamProgram* prog, uint8_t const* stream );
+uint8_t Stream_execute( StreamProgram* prog );
+
+
+// Storage for the state of a running program. A program owns one instance for as long as it runs,
+// so all programs share the same memory (no dynamic memory allocation required). The main loop
+// keeps one instance per program that can run at the same time (two during a crossfade).
+typedef union
+{
+	MixedColorBlendingProgram mixedColorBlending;
+	KnightRiderProgram knightRider;
+	ColoredConveyorProgram coloredConveyor;
+	TestDisplaysProgram testDisplays;
+	RainbowProgram rainbow;
+	CandleFlickerProgram candleFlicker;
+	ScriptProgram script;
+	StreamProgram stream;
+}
+AnimationProgramStorage;
+
+
+#endif // ANIMATIONS_H_
@@ -0,0 +1,1045 @@
+/**
+ * Cycle-accurate benchmark of the firmware, using the simavr AVR simulator
+ *
+ * This runs the real firmware (ledterne.out) in a simulated ATmega8 and profiles function calls by
+ * watching the program counter: A call of a profiled function starts when the program counter
+ * reaches the function's address and ends when the stack pointer rises above its value at the
+ * function's entry (i.e. when the function returns). Interrupt handlers are profiled the same way
+ * (from the first instruction of the handler up to and including the reti). The cycles spent in
+ * interrupt handlers are not counted for the functions they interrupt.
+ *
+ * Profiled are all interrupt handlers, all animation programs (*_execute), commitFrame(),
+ * pwmUpdate() and pwmDither(), plus any functions given with -f. The symbol addresses are read from the output of
+ * avr-nm (see 'make bench').
+ *
+ * Reported are:
+ *
+ * - the number of calls and the min/avg/max cycles per call of each profiled function,
+ * - the CPU load, i.e. the share of cycles spent in interrupt handlers, in frame updates and in
+ *   dithering the PWM (pwmDither()),
+ * - the latency of frame updates: the time from the time base interrupt (TIMER1_COMPA_vect) that
+ *   signals a due frame (by setting g_frameUpdateRequired) to the return of the following
+ *   commitFrame(),
+ * - the share of cycles the CPU is sleeping and the firmware's power state counters
+ *   (g_powerStateFrames: the number of frames displayed with the PWM timer running and stopped),
+ * - the firmware's transition counters (g_transitions: the number of completed crossfades between
+ *   modules and the number of crossfades that were cut short because they exceeded their budget),
+ * - the firmware's frame scheduler counters (g_frameStats: the number of frame updates that came
+ *   too late, the number of program steps that have been caught up with in a single frame, and the
+ *   number of missed frames that have been skipped),
+ * - the current profile of the LEDs: the number of LEDs lit at the same time, tracked after each
+ *   instruction, as mean, RMS and peak (in units of the current of a single LED, assuming all LEDs
+ *   draw the same), and the share of time at the peak. The mean follows from the duty cycles, the
+ *   RMS and the peak show how evenly the PWM spreads the on-phases (see PWM_STAGGER in pwm.h),
+ * - with -b, the latency of the push button on PD3: presses (including bouncing contacts) are
+ *   injected as pin changes, measured is the time from the first edge to the return of the
+ *   following commitFrame(), i.e. until the next module's first frame is handed to the PWM (it is
+ *   displayed from the start of the next PWM cycle).
+ *
+ * With -u, the output of the USART (e.g. the records of the telemetry build, see telemetry.h) is
+ * written to a file. With -i, a file is fed to the input of the USART at the speed of the serial
+ * line (USART_BAUD, 8N1), over and over (e.g. the frame packets of tools/sendframes for the serial
+ * frames build, see serial.h), and the firmware's serial counters are reported (g_serialStats: the
+ * number of valid and invalid packets and of lost bytes).
+ *
+ * With -x, the firmware's LEDs are on a chain of 74HC595 shift registers (the shift register build,
+ * see PWM_OUTPUT in pwm.h): The registers are simulated on the SPI and their latch on PB2, and the
+ * share of time each of their outputs has been on is reported (i.e. the average brightness of the
+ * LEDs).
+ *
+ * With -w, the waveform of the PWM is written to a file, for comparing different implementations
+ * of PWM_ENGINE_STEP (see PWM_ASM in pwm.h): the LED ports after each call of TIMER2_COMP_vect
+ * (i.e. after each PWM step), one line per PWM cycle with runs of equal port values ("steps:PORTB
+ * PORTC PORTD" in hex). A PWM cycle ends after 256 steps or when the handler stops the timer.
+ * Repeated PWM cycles are written once, so that the file does not depend on the exact PWM cycle a
+ * new frame starts with.
+ */
+
+#include "../usart.h"
+
+#include "avr_ioport.h"
+#include "avr_spi.h"
+#include "avr_uart.h"
+#include "sim_avr.h"
+#include "sim_elf.h"
+#include "sim_io.h"
+
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+
+#define F_CPU 8000000UL
+
+// offset of SRAM addresses in the ELF file (as reported by avr-nm)
+#define DATA_OFFSET 0x800000UL
+
+// stack pointer (data space addresses)
+#define ADDR_SPL 0x5d
+#define ADDR_SPH 0x5e
+
+// LED ports and the PWM timer's control register (data space addresses)
+#define ADDR_PORTB 0x38
+#define ADDR_PORTC 0x35
+#define ADDR_PORTD 0x32
+#define ADDR_TCCR2 0x45
+
+// LED pins in PORTB, PORTC and PORTD (see g_channels in pwm.c)
+#define LED_PINS_B 0x3f
+#define LED_PINS_C 0x07
+#define LED_PINS_D 0xe7
+
+#define FLASH_SIZE 8192
+#define MAX_FUNCTIONS 64
+#define MAX_CALL_DEPTH 32
+
+
+// interrupt vector names of the ATmega8 (avr-gcc names the handlers __vector_N)
+static char const* const g_vectorNames[] =
+{
+	"RESET",
+	"INT0_vect",
+	"INT1_vect",
+	"TIMER2_COMP_vect",
+	"TIMER2_OVF_vect",
+	"TIMER1_CAPT_vect",
+	"TIMER1_COMPA_vect",
+	"TIMER1_COMPB_vect",
+	"TIMER1_OVF_vect",
+	"TIMER0_OVF_vect",
+	"SPI_STC_vect",
+	"USART_RXC_vect",
+	"USART_UDRE_vect",
+	"USART_TXC_vect",
+	"ADC_vect",
+	"EE_RDY_vect",
+	"ANA_COMP_vect",
+	"TWI_vect",
+	"SPM_RDY_vect",
+};
+
+#define NUM_VECTORS ( sizeof( g_vectorNames ) / sizeof( g_vectorNames[ 0 ] ) )
+
+
+typedef struct
+{
+	char name[ 64 ];
+	uint32_t addr;
+	int isIsr;
+	int isFrameUpdate; // counts as frame update for the CPU load
+	int isDither;      // counts as dithering for the CPU load
+
+	uint64_t calls;
+	uint64_t minCycles;
+	uint64_t maxCycles;
+	uint64_t totalCycles;
+}
+function_t;
+
+static function_t g_functions[ MAX_FUNCTIONS ];
+static int g_numFunctions = 0;
+
+// profiled function (index + 1) for each word address in flash
+static uint8_t g_functionAt[ FLASH_SIZE / 2 ];
+
+
+typedef struct
+{
+	function_t* function;
+	uint16_t entrySp;
+	uint64_t entryCycle;
+	uint64_t entryIsrCycles;
+}
+call_t;
+
+static call_t g_callStack[ MAX_CALL_DEPTH ];
+static int g_callDepth = 0;
+
+// total cycles spent in interrupt handlers
+static uint64_t g_isrCycles = 0;
+
+// total cycles spent in frame updates (excluding interrupt handlers)
+static uint64_t g_frameCycles = 0;
+
+// total cycles spent in pwmDither() (excluding interrupt handlers)
+static uint64_t g_ditherCycles = 0;
+
+// total cycles the CPU is sleeping
+static uint64_t g_sleepCycles = 0;
+
+// counter arrays of the firmware (uint16_t), reported at the end
+#define MAX_COUNTERS 4
+
+typedef struct
+{
+	char const* symbol;
+	char const* title;
+	char const* names[ MAX_COUNTERS ];
+	uint32_t addr; // SRAM address (0 if the firmware does not have the counters, see readSymbols())
+}
+counters_t;
+
+static counters_t g_counters[] =
+{
+	{ "g_powerStateFrames", "frames per power state", { "PWM running", "PWM stopped" } },
+	{ "g_transitions", "transitions between modules", { "crossfade", "cut" } },
+	{ "g_frameStats", "frame scheduler", { "late updates", "steps caught up", "frames skipped" } },
+	{ "g_serialStats", "serial frames", { "received", "invalid", "rx errors" } },
+};
+
+#define NUM_COUNTERS ( sizeof( g_counters ) / sizeof( g_counters[ 0 ] ) )
+
+// SRAM address of the firmware's frame update flag (0 if there is none)
+static uint32_t g_frameUpdateRequiredAddr = 0;
+
+// frame latency: tick to end of commitFrame()
+static uint64_t g_tickCycle = 0;
+static int g_tickPending = 0;
+static uint64_t g_numLatencies = 0;
+static uint64_t g_minLatency = UINT64_MAX;
+static uint64_t g_maxLatency = 0;
+static uint64_t g_totalLatency = 0;
+
+// file for the output of the USART (NULL: discard it)
+static FILE* g_uartFile = NULL;
+
+// data fed to the input of the USART (see -i), one byte per character time of the serial line
+#define UART_BYTE_CYCLES ( 10 * F_CPU / USART_BAUD )
+static uint8_t* g_uartInput = NULL;
+static size_t g_uartInputSize = 0;
+static uint64_t g_uartInputBytes = 0;
+
+// chain of 74HC595 shift registers on the SPI (see -x): [ 0 ] is the first one (at MOSI), a byte
+// sent over the SPI pushes the others one register further along the chain
+#define MAX_SHIFT_REGISTERS 16
+static int g_numShiftRegisters = 0;
+static uint8_t g_shiftRegisters[ MAX_SHIFT_REGISTERS ];
+static uint8_t g_shiftOutputs[ MAX_SHIFT_REGISTERS ]; // latched
+static uint64_t g_latchCycle = 0;
+static uint64_t g_numLatches = 0;
+static uint64_t g_shiftOnCycles[ 8 * MAX_SHIFT_REGISTERS ];
+
+// current profile: cycles with each number of lit LEDs, the current number and since when
+#define MAX_LIT_LEDS ( 8 * MAX_SHIFT_REGISTERS )
+static uint64_t g_litCycles[ MAX_LIT_LEDS + 1 ];
+static int g_numLit = 0;
+static uint64_t g_litCycle = 0;
+
+// waveform of the PWM (see -w): the LED ports of each step of the current PWM cycle, and the
+// previous PWM cycle that has been written
+#define PWM_STEPS 256
+static FILE* g_waveFile = NULL;
+static uint8_t g_waveCycle[ 2 ][ PWM_STEPS ][ 3 ];
+static int g_waveSteps[ 2 ];
+static int g_waveCurrent = 0;
+
+// button on PD3: pin changes of a press relative to its start (us), alternating between pressed
+// (low) and released (high), with bouncing contacts on pressing and releasing
+static uint32_t const g_buttonEdges[] = { 0, 150, 300, 500, 700, 100000, 100200, 100500 };
+#define NUM_BUTTON_EDGES ( sizeof( g_buttonEdges ) / sizeof( g_buttonEdges[ 0 ] ) )
+
+// button latency: first edge of a press to end of commitFrame()
+static uint64_t g_pressCycle = 0;
+static int g_pressPending = 0;
+static uint64_t g_numPresses = 0;
+static uint64_t g_numPressLatencies = 0;
+static uint64_t g_minPressLatency = UINT64_MAX;
+static uint64_t g_maxPressLatency = 0;
+static uint64_t g_totalPressLatency = 0;
+
+
+static function_t* addFunction( char const* name, uint32_t addr )
+{
+	if( g_numFunctions == MAX_FUNCTIONS || addr >= FLASH_SIZE )
+	{
+		return NULL;
+	}
+
+	function_t* f = &g_functions[ g_numFunctions ];
+	memset( f, 0, sizeof( *f ) );
+	snprintf( f->name, sizeof( f->name ), "%s", name );
+	f->addr = addr;
+	f->minCycles = UINT64_MAX;
+
+	g_functionAt[ addr / 2 ] = ++g_numFunctions;
+
+	return f;
+}
+
+
+static int endsWith( char const* s, char const* suffix )
+{
+	size_t n = strlen( s );
+	size_t m = strlen( suffix );
+	return n >= m && strcmp( s + n - m, suffix ) == 0;
+}
+
+
+/**
+ * @brief Read the symbols (output of 'avr-nm') and select the functions to profile
+ */
+static int readSymbols( char const* path, char** extra, int numExtra )
+{
+	FILE* f = fopen( path, "r" );
+	if( !f )
+	{
+		perror( path );
+		return 0;
+	}
+
+	char line[ 256 ];
+
+	while( fgets( line, sizeof( line ), f ) )
+	{
+		unsigned long addr;
+		char type;
+		char name[ 128 ];
+
+		if( sscanf( line, "%lx %c %127s", &addr, &type, name ) != 3 )
+		{
+			continue;
+		}
+
+		unsigned int vector;
+		int selected = 0;
+		int i;
+
+		// avr-nm shows SRAM addresses with an offset of 0x800000
+		if( addr >= DATA_OFFSET )
+		{
+			for( i = 0; i < (int) NUM_COUNTERS; i++ )
+			{
+				if( strcmp( name, g_counters[ i ].symbol ) == 0 )
+				{
+					g_counters[ i ].addr = addr - DATA_OFFSET;
+				}
+			}
+
+			if( strcmp( name, "g_frameUpdateRequired" ) == 0 )
+			{
+				g_frameUpdateRequiredAddr = addr - DATA_OFFSET;
+			}
+
+			continue;
+		}
+
+		// functions only
+		if( type != 'T' && type != 't' )
+		{
+			continue;
+		}
+
+		for( i = 0; i < numExtra; i++ )
+		{
+			selected |= strcmp( name, extra[ i ] ) == 0;
+		}
+
+		if( sscanf( name, "__vector_%u", &vector ) == 1 && vector < NUM_VECTORS )
+		{
+			function_t* fn = addFunction( g_vectorNames[ vector ], addr );
+			if( fn )
+			{
+				fn->isIsr = 1;
+			}
+		}
+		else if( endsWith( name, "_execute" ) || strcmp( name, "commitFrame" ) == 0 )
+		{
+			function_t* fn = addFunction( name, addr );
+			if( fn )
+			{
+				fn->isFrameUpdate = 1;
+			}
+		}
+		else if( strcmp( name, "pwmDither" ) == 0 )
+		{
+			function_t* fn = addFunction( name, addr );
+			if( fn )
+			{
+				fn->isDither = 1;
+			}
+		}
+		else if( selected || strcmp( name, "pwmUpdate" ) == 0 )
+		{
+			addFunction( name, addr );
+		}
+	}
+
+	fclose( f );
+
+	return 1;
+}
+
+
+static uint16_t getSp( avr_t* avr )
+{
+	return avr->data[ ADDR_SPL ] | ( avr->data[ ADDR_SPH ] << 8 );
+}
+
+
+/**
+ * @brief Write the current PWM cycle of the waveform if it differs from the previous one
+ */
+static void writeWaveCycle( void )
+{
+	int const cur = g_waveCurrent;
+	int const prev = cur ^ 1;
+	int n = g_waveSteps[ cur ];
+	int i;
+
+	if( n == 0 )
+	{
+		return;
+	}
+
+	if( n != g_waveSteps[ prev ] || memcmp( g_waveCycle[ cur ], g_waveCycle[ prev ], 3 * n ) != 0 )
+	{
+		for( i = 0; i < n; )
+		{
+			uint8_t const* ports = g_waveCycle[ cur ][ i ];
+			int run = 1;
+
+			while( i + run < n && memcmp( g_waveCycle[ cur ][ i + run ], ports, 3 ) == 0 )
+			{
+				run += 1;
+			}
+
+			fprintf( g_waveFile, "%s%d:%02x %02x %02x", i > 0 ? " " : "", run,
+			         ports[ 0 ], ports[ 1 ], ports[ 2 ] );
+			i += run;
+		}
+
+		fprintf( g_waveFile, "\n" );
+		g_waveCurrent = prev;
+	}
+
+	g_waveSteps[ g_waveCurrent ] = 0;
+}
+
+
+/**
+ * @brief Record a step of the PWM (at the end of a call of TIMER2_COMP_vect)
+ */
+static void recordWaveStep( avr_t const* avr )
+{
+	uint8_t* ports = g_waveCycle[ g_waveCurrent ][ g_waveSteps[ g_waveCurrent ]++ ];
+
+	ports[ 0 ] = avr->data[ ADDR_PORTB ];
+	ports[ 1 ] = avr->data[ ADDR_PORTC ];
+	ports[ 2 ] = avr->data[ ADDR_PORTD ];
+
+	// the timer has been stopped (the outputs are constant), it restarts with a new PWM cycle
+	int const stopped = ( avr->data[ ADDR_TCCR2 ] & 0x07 ) == 0;
+
+	if( stopped || g_waveSteps[ g_waveCurrent ] == PWM_STEPS )
+	{
+		writeWaveCycle();
+	}
+}
+
+
+static void endCall( avr_t const* avr, call_t const* call, uint64_t cycle )
+{
+	function_t* f = call->function;
+	uint64_t cycles = cycle - call->entryCycle;
+
+	if( f->isIsr )
+	{
+		g_isrCycles += cycles;
+
+		if( g_waveFile && strcmp( f->name, "TIMER2_COMP_vect" ) == 0 )
+		{
+			recordWaveStep( avr );
+		}
+
+		// the time base interrupt that signals the next frame
+		if( strcmp( f->name, "TIMER1_COMPA_vect" ) == 0 && !g_tickPending
+		    && g_frameUpdateRequiredAddr && avr->data[ g_frameUpdateRequiredAddr ] )
+		{
+			g_tickCycle = call->entryCycle;
+			g_tickPending = 1;
+		}
+	}
+	else
+	{
+		// do not count interrupt handlers for the interrupted function
+		cycles -= g_isrCycles - call->entryIsrCycles;
+
+		// only count the outermost frame update (commitFrame() is called after *_execute())
+		if( f->isFrameUpdate )
+		{
+			g_frameCycles += cycles;
+		}
+
+		if( f->isDither )
+		{
+			g_ditherCycles += cycles;
+		}
+
+		if( strcmp( f->name, "commitFrame" ) == 0 && g_tickPending )
+		{
+			uint64_t latency = cycle - g_tickCycle;
+
+			g_numLatencies += 1;
+			g_totalLatency += latency;
+			if( latency < g_minLatency ) { g_minLatency = latency; }
+			if( latency > g_maxLatency ) { g_maxLatency = latency; }
+
+			g_tickPending = 0;
+		}
+
+		if( strcmp( f->name, "commitFrame" ) == 0 && g_pressPending )
+		{
+			uint64_t latency = cycle - g_pressCycle;
+
+			g_numPressLatencies += 1;
+			g_totalPressLatency += latency;
+			if( latency < g_minPressLatency ) { g_minPressLatency = latency; }
+			if( latency > g_maxPressLatency ) { g_maxPressLatency = latency; }
+
+			g_pressPending = 0;
+		}
+	}
+
+	f->calls += 1;
+	f->totalCycles += cycles;
+	if( cycles < f->minCycles ) { f->minCycles = cycles; }
+	if( cycles > f->maxCycles ) { f->maxCycles = cycles; }
+}
+
+
+/**
+ * @brief Track calls and returns of the profiled functions after each instruction
+ */
+static void profile( avr_t* avr )
+{
+	uint16_t sp = getSp( avr );
+
+	// returns (the stack pointer rises above its value at the entry of the function)
+	while( g_callDepth > 0 && sp > g_callStack[ g_callDepth - 1 ].entrySp )
+	{
+		g_callDepth -= 1;
+		endCall( avr, &g_callStack[ g_callDepth ], avr->cycle );
+	}
+
+	// calls
+	uint32_t pc = avr->pc;
+	uint8_t index = pc < FLASH_SIZE ? g_functionAt[ pc / 2 ] : 0;
+
+	if( index && g_callDepth < MAX_CALL_DEPTH )
+	{
+		call_t* call = &g_callStack[ g_callDepth++ ];
+		call->function = &g_functions[ index - 1 ];
+		call->entrySp = sp;
+		call->entryCycle = avr->cycle;
+		call->entryIsrCycles = g_isrCycles;
+	}
+}
+
+
+/**
+ * @brief Write a byte sent by the USART to the file
+ */
+static void uartOutput( avr_irq_t* irq, uint32_t value, void* param )
+{
+	fputc( value, g_uartFile );
+}
+
+
+/**
+ * @brief Read the whole file that is fed to the USART
+ */
+static int readUartInput( char const* path )
+{
+	FILE* in = fopen( path, "rb" );
+	if( !in )
+	{
+		perror( path );
+		return 0;
+	}
+
+	size_t capacity = 0;
+	size_t n;
+
+	do
+	{
+		if( g_uartInputSize == capacity )
+		{
+			capacity = capacity ? 2 * capacity : 4096;
+			g_uartInput = realloc( g_uartInput, capacity );
+			if( !g_uartInput )
+			{
+				perror( "realloc" );
+				return 0;
+			}
+		}
+
+		n = fread( g_uartInput + g_uartInputSize, 1, capacity - g_uartInputSize, in );
+		g_uartInputSize += n;
+	}
+	while( n > 0 );
+
+	fclose( in );
+
+	if( g_uartInputSize == 0 )
+	{
+		fprintf( stderr, "%s is empty\n", path );
+		return 0;
+	}
+
+	return 1;
+}
+
+
+/**
+ * @brief Shift a byte sent over the SPI into the shift registers
+ */
+static void spiOutput( avr_irq_t* irq, uint32_t value, void* param )
+{
+	memmove( &g_shiftRegisters[ 1 ], &g_shiftRegisters[ 0 ], g_numShiftRegisters - 1 );
+	g_shiftRegisters[ 0 ] = value;
+}
+
+
+/**
+ * @brief Count the on time of the shift register outputs up to the given cycle
+ */
+static void countShiftOutputs( uint64_t cycle )
+{
+	int i;
+
+	for( i = 0; i < 8 * g_numShiftRegisters; i++ )
+	{
+		if( g_shiftOutputs[ i / 8 ] & ( 1 << ( i % 8 ) ) )
+		{
+			g_shiftOnCycles[ i ] += cycle - g_latchCycle;
+		}
+	}
+
+	g_latchCycle = cycle;
+}
+
+
+/**
+ * @brief Latch the shift registers on a rising edge of PB2
+ */
+static void latchInput( avr_irq_t* irq, uint32_t value, void* param )
+{
+	avr_t const* avr = param;
+
+	if( !value )
+	{
+		return;
+	}
+
+	countShiftOutputs( avr->cycle );
+	memcpy( g_shiftOutputs, g_shiftRegisters, g_numShiftRegisters );
+	g_numLatches += 1;
+}
+
+
+/**
+ * @brief Count the LEDs that are lit (after each instruction) for the current profile
+ */
+static void countLitLeds( avr_t const* avr )
+{
+	int lit = 0;
+	int i;
+
+	if( g_numShiftRegisters > 0 )
+	{
+		for( i = 0; i < g_numShiftRegisters; i++ )
+		{
+			lit += __builtin_popcount( g_shiftOutputs[ i ] );
+		}
+	}
+	else
+	{
+		lit = __builtin_popcount( avr->data[ ADDR_PORTB ] & LED_PINS_B )
+		    + __builtin_popcount( avr->data[ ADDR_PORTC ] & LED_PINS_C )
+		    + __builtin_popcount( avr->data[ ADDR_PORTD ] & LED_PINS_D );
+	}
+
+	g_litCycles[ g_numLit ] += avr->cycle - g_litCycle;
+	g_litCycle = avr->cycle;
+	g_numLit = lit;
+}
+
+
+static void printReport( FILE* out, avr_t const* avr )
+{
+	uint64_t totalCycles = avr->cycle;
+	int i;
+
+	fprintf( out, "simulated: %.3f s (%" PRIu64 " cycles @ %lu Hz)\n\n",
+	         (double) totalCycles / F_CPU, totalCycles, F_CPU );
+
+	fprintf( out, "%-28s %10s %8s %10s %8s %7s\n",
+	         "function", "calls", "min", "avg", "max", "cpu %" );
+
+	for( i = 0; i < g_numFunctions; i++ )
+	{
+		function_t const* f = &g_functions[ i ];
+
+		if( f->calls == 0 )
+		{
+			continue;
+		}
+
+		fprintf( out, "%-28s %10" PRIu64 " %8" PRIu64 " %10.1f %8" PRIu64 " %7.2f\n",
+		         f->name, f->calls, f->minCycles, (double) f->totalCycles / f->calls,
+		         f->maxCycles, 100.0 * f->totalCycles / totalCycles );
+	}
+
+	fprintf( out, "\nCPU load: %.2f %% "
+	         "(interrupts %.2f %%, frame updates %.2f %%, dithering %.2f %%)\n",
+	         100.0 * ( g_isrCycles + g_frameCycles + g_ditherCycles ) / totalCycles,
+	         100.0 * g_isrCycles / totalCycles,
+	         100.0 * g_frameCycles / totalCycles,
+	         100.0 * g_ditherCycles / totalCycles );
+
+	if( g_numLatencies > 0 )
+	{
+		fprintf( out, "frame latency (TIMER1_COMPA_vect to end of commitFrame): "
+		         "min %" PRIu64 " avg %.1f max %" PRIu64 " cycles (max %.1f us)\n",
+		         g_minLatency, (double) g_totalLatency / g_numLatencies, g_maxLatency,
+		         1e6 * g_maxLatency / F_CPU );
+	}
+
+	if( g_numPresses > 0 )
+	{
+		function_t const* isr = NULL;
+
+		for( i = 0; i < g_numFunctions; i++ )
+		{
+			if( strcmp( g_functions[ i ].name, "INT1_vect" ) == 0 )
+			{
+				isr = &g_functions[ i ];
+			}
+		}
+
+		fprintf( out, "button: %" PRIu64 " presses, %" PRIu64 " detected (INT1_vect)\n",
+		         g_numPresses, isr ? isr->calls : 0 );
+
+		if( g_numPressLatencies > 0 )
+		{
+			fprintf( out, "button latency (press to end of commitFrame): "
+			         "min %" PRIu64 " avg %.1f max %" PRIu64 " cycles (max %.1f us)\n",
+			         g_minPressLatency, (double) g_totalPressLatency / g_numPressLatencies,
+			         g_maxPressLatency, 1e6 * g_maxPressLatency / F_CPU );
+		}
+	}
+
+	if( g_uartInputBytes > 0 )
+	{
+		fprintf( out, "USART input: %" PRIu64 " bytes (%d baud)\n", g_uartInputBytes, USART_BAUD );
+	}
+
+	if( g_numShiftRegisters > 0 )
+	{
+		fprintf( out, "shift registers: %d, %" PRIu64 " latches, on time of the outputs (%%):\n",
+		         g_numShiftRegisters, g_numLatches );
+
+		// in the order of the firmware's channels: R, G, B of each pixel
+		for( i = 0; i < 8 * g_numShiftRegisters; i += 3 )
+		{
+			int c;
+
+			fprintf( out, "  pixel %2d:", i / 3 );
+
+			for( c = i; c < i + 3 && c < 8 * g_numShiftRegisters; c++ )
+			{
+				fprintf( out, " %6.2f", 100.0 * g_shiftOnCycles[ c ] / totalCycles );
+			}
+
+			fprintf( out, "\n" );
+		}
+	}
+
+	double litSum = 0.0;
+	double litSquares = 0.0;
+	int peak = 0;
+
+	for( i = 0; i <= MAX_LIT_LEDS; i++ )
+	{
+		litSum += (double) i * g_litCycles[ i ];
+		litSquares += (double) i * i * g_litCycles[ i ];
+		peak = g_litCycles[ i ] > 0 ? i : peak;
+	}
+
+	fprintf( out, "LED current (lit LEDs): mean %.2f, RMS %.2f, peak %d (%.2f %% of the time)\n",
+	         litSum / totalCycles, sqrt( litSquares / totalCycles ), peak,
+	         100.0 * g_litCycles[ peak ] / totalCycles );
+
+	fprintf( out, "sleeping: %.2f %% (%" PRIu64 " cycles)\n",
+	         100.0 * g_sleepCycles / totalCycles, g_sleepCycles );
+
+	for( i = 0; i < (int) NUM_COUNTERS; i++ )
+	{
+		counters_t const* c = &g_counters[ i ];
+		int j;
+
+		if( !c->addr )
+		{
+			continue;
+		}
+
+		fprintf( out, "%s:", c->title );
+
+		for( j = 0; j < MAX_COUNTERS && c->names[ j ]; j++ )
+		{
+			uint32_t addr = c->addr + 2 * j;
+			fprintf( out, " %s %u", c->names[ j ], avr->data[ addr ] | ( avr->data[ addr + 1 ] << 8 ) );
+		}
+
+		fprintf( out, "\n" );
+	}
+}
+
+
+static void usage( char const* argv0 )
+{
+	fprintf( stderr,
+		"usage: %s -s symbols [-t seconds] [-f function]... [-b seconds] [-u file] [-i file]\n"
+		"       [-x registers] [-w file] [-r report] firmware.out\n"
+		"\n"
+		"  -s symbols   output of 'avr-nm' for the firmware\n"
+		"  -t seconds   simulated time (default 10)\n"
+		"  -f function  additionally profile this function (may be repeated)\n"
+		"  -b seconds   press the button on PD3 periodically (default: never)\n"
+		"  -u file      write the output of the USART to this file\n"
+		"  -i file      feed this file to the input of the USART (repeatedly)\n"
+		"  -x registers simulate a chain of 74HC595 shift registers on the SPI (latch on PB2)\n"
+		"  -w file      write the waveform of the PWM (PWM_ENGINE_STEP) to this file\n"
+		"  -r report    also write the report to this file\n",
+		argv0 );
+	exit( 2 );
+}
+
+
+int main( int argc, char** argv )
+{
+	char const* symbols = NULL;
+	char const* reportPath = NULL;
+	char const* uartPath = NULL;
+	char const* uartInputPath = NULL;
+	char const* wavePath = NULL;
+	double seconds = 10.0;
+	double buttonPeriod = 0.0;
+	char* extra[ MAX_FUNCTIONS ];
+	int numExtra = 0;
+	int opt;
+
+	while( ( opt = getopt( argc, argv, "s:t:f:b:u:i:x:w:r:h" ) ) != -1 )
+	{
+		switch( opt )
+		{
+			case 's':
+				symbols = optarg;
+				break;
+			case 't':
+				seconds = atof( optarg );
+				break;
+			case 'f':
+				if( numExtra < MAX_FUNCTIONS )
+				{
+					extra[ numExtra++ ] = optarg;
+				}
+				break;
+			case 'b':
+				buttonPeriod = atof( optarg );
+				break;
+			case 'u':
+				uartPath = optarg;
+				break;
+			case 'i':
+				uartInputPath = optarg;
+				break;
+			case 'x':
+				g_numShiftRegisters = atoi( optarg );
+				break;
+			case 'w':
+				wavePath = optarg;
+				break;
+			case 'r':
+				reportPath = optarg;
+				break;
+			default:
+				usage( argv[ 0 ] );
+		}
+	}
+
+	if( !symbols || optind + 1 != argc || g_numShiftRegisters < 0
+	    || g_numShiftRegisters > MAX_SHIFT_REGISTERS )
+	{
+		usage( argv[ 0 ] );
+	}
+
+	if( !readSymbols( symbols, extra, numExtra ) )
+	{
+		return 1;
+	}
+
+	if( uartInputPath && !readUartInput( uartInputPath ) )
+	{
+		return 1;
+	}
+
+	elf_firmware_t firmware;
+	memset( &firmware, 0, sizeof( firmware ) );
+
+	if( elf_read_firmware( argv[ optind ], &firmware ) != 0 )
+	{
+		fprintf( stderr, "cannot read firmware %s\n", argv[ optind ] );
+		return 1;
+	}
+
+	strcpy( firmware.mmcu, "atmega8" );
+	firmware.frequency = F_CPU;
+
+	avr_t* avr = avr_make_mcu_by_name( firmware.mmcu );
+	if( !avr )
+	{
+		fprintf( stderr, "simavr does not support %s\n", firmware.mmcu );
+		return 1;
+	}
+
+	avr_init( avr );
+	avr_load_firmware( avr, &firmware );
+
+	uint64_t endCycle = (uint64_t) ( seconds * F_CPU );
+
+	// capture the output of the USART (instead of printing it)
+	if( uartPath )
+	{
+		g_uartFile = fopen( uartPath, "wb" );
+		if( !g_uartFile )
+		{
+			perror( uartPath );
+			return 1;
+		}
+
+		uint32_t flags = 0;
+		avr_ioctl( avr, AVR_IOCTL_UART_GET_FLAGS( '0' ), &flags );
+		flags &= ~AVR_UART_FLAG_STDIO;
+		avr_ioctl( avr, AVR_IOCTL_UART_SET_FLAGS( '0' ), &flags );
+
+		avr_irq_register_notify( avr_io_getirq( avr, AVR_IOCTL_UART_GETIRQ( '0' ), UART_IRQ_OUTPUT ),
+		                         uartOutput, NULL );
+	}
+
+	if( g_numShiftRegisters > 0 )
+	{
+		avr_irq_register_notify( avr_io_getirq( avr, AVR_IOCTL_SPI_GETIRQ( '0' ), SPI_IRQ_OUTPUT ),
+		                         spiOutput, NULL );
+		avr_irq_register_notify( avr_io_getirq( avr, AVR_IOCTL_IOPORT_GETIRQ( 'B' ), 2 ),
+		                         latchInput, avr );
+	}
+
+	if( wavePath )
+	{
+		g_waveFile = fopen( wavePath, "w" );
+		if( !g_waveFile )
+		{
+			perror( wavePath );
+			return 1;
+		}
+	}
+
+	avr_irq_t* uartInput = avr_io_getirq( avr, AVR_IOCTL_UART_GETIRQ( '0' ), UART_IRQ_INPUT );
+	uint64_t uartInputCycle = 0;
+
+	// the button is released (the pin is pulled up)
+	avr_irq_t* buttonPin = avr_io_getirq( avr, AVR_IOCTL_IOPORT_GETIRQ( 'D' ), 3 );
+	avr_raise_irq( buttonPin, 1 );
+
+	uint64_t buttonPeriodCycles = (uint64_t) ( buttonPeriod * F_CPU );
+	uint64_t pressStart = buttonPeriodCycles;
+	unsigned int buttonEdge = 0;
+
+	while( avr->cycle < endCycle )
+	{
+		// inject the pin changes of the button presses
+		uint64_t edgeCycle = pressStart + g_buttonEdges[ buttonEdge ] * ( F_CPU / 1000000 );
+
+		if( buttonPeriodCycles > 0 && avr->cycle >= edgeCycle )
+		{
+			avr_raise_irq( buttonPin, buttonEdge % 2 );
+
+			if( buttonEdge == 0 )
+			{
+				g_pressCycle = avr->cycle;
+				g_pressPending = 1;
+				g_numPresses += 1;
+			}
+
+			buttonEdge += 1;
+			if( buttonEdge == NUM_BUTTON_EDGES )
+			{
+				buttonEdge = 0;
+				pressStart += buttonPeriodCycles;
+			}
+		}
+
+		// feed the next byte to the USART
+		if( g_uartInputSize > 0 && avr->cycle >= uartInputCycle )
+		{
+			avr_raise_irq( uartInput, g_uartInput[ g_uartInputBytes % g_uartInputSize ] );
+			g_uartInputBytes += 1;
+			uartInputCycle += UART_BYTE_CYCLES;
+		}
+
+		uint64_t cycle = avr->cycle;
+		int sleeping = avr->state == cpu_Sleeping;
+
+		int state = avr_run( avr );
+
+		if( sleeping )
+		{
+			g_sleepCycles += avr->cycle - cycle;
+		}
+
+		if( state == cpu_Done || state == cpu_Crashed )
+		{
+			fprintf( stderr, "simulation stopped at cycle %" PRIu64 "\n", (uint64_t) avr->cycle );
+			return 1;
+		}
+
+		profile( avr );
+		countLitLeds( avr );
+	}
+
+	if( g_uartFile )
+	{
+		fclose( g_uartFile );
+	}
+
+	free( g_uartInput );
+
+	if( g_waveFile )
+	{
+		fclose( g_waveFile );
+	}
+
+	countShiftOutputs( avr->cycle );
+	countLitLeds( avr );
+
+	printReport( stdout, avr );
+
+	if( reportPath )
+	{
+		FILE* out = fopen( reportPath, "w" );
+		if( !out )
+		{
+			perror( reportPath );
+			return 1;
+		}
+
+		printReport( out, avr );
+		fclose( out );
+	}
+
+	return 0;
+}
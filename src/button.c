@@ -0,0 +1,110 @@
+/**
+ * Push button on PD3 (INT1) for switching between the animation modules
+ *
+ * The button connects PD3 to ground, the internal pull-up keeps the pin high otherwise. A press is
+ * detected by the external interrupt INT1 on the falling edge and reported right away, so there is
+ * no polling and no delay. A mechanical button bounces for a few milliseconds though, so INT1 is
+ * then disabled and timer 0 takes over: it samples the pin every DEBOUNCE_MS and enables INT1
+ * again only after the button has been released for two samples in a row (i.e. once the bouncing
+ * of the release is over as well). Timer 0 only runs while the button is being debounced.
+ */
+
+// clock frequency
+#ifndef F_CPU
+#define F_CPU 8000000L
+#endif
+
+#include "button.h"
+#include "telemetry.h"
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+
+// sampling period of the pin while debouncing (at most 32 ms)
+#define DEBOUNCE_MS 20
+
+// timer 0 ticks per sampling period (1/1024 clock frequency)
+#define DEBOUNCE_TICKS ( F_CPU / 1024 * DEBOUNCE_MS / 1000 )
+
+#if DEBOUNCE_TICKS > 256
+#error "DEBOUNCE_MS is too long for timer 0"
+#endif
+
+
+volatile uint8_t g_buttonPressed = 0;
+
+// number of successive samples with the button released
+static uint8_t g_releasedSamples;
+
+
+static void debounceTimerStart( void )
+{
+	// timer 0 only has an overflow interrupt, so count up from the start value
+	TCNT0 = 256 - DEBOUNCE_TICKS;
+
+	// prescaler: 1/1024 clock frequency
+	TCCR0 = (1<<CS02) | (1<<CS00);
+}
+
+
+/**
+ * @brief Interrupt handler for the button being pressed (falling edge on PD3)
+ */
+TELEMETRY_ISR( INT1_vect, TELEMETRY_ISR_BUTTON )
+{
+	g_buttonPressed = 1;
+
+	// ignore the bouncing
+	GICR &= ~(1<<INT1);
+	g_releasedSamples = 0;
+	debounceTimerStart();
+}
+
+
+/**
+ * @brief Interrupt handler for sampling the button while debouncing
+ */
+TELEMETRY_ISR( TIMER0_OVF_vect, TELEMETRY_ISR_BUTTON )
+{
+	if( PIND & (1<<PD3) )
+	{
+		g_releasedSamples += 1;
+	}
+	else
+	{
+		g_releasedSamples = 0;
+	}
+
+	if( g_releasedSamples < 2 )
+	{
+		debounceTimerStart();
+		return;
+	}
+
+	// released: stop the timer and wait for the next press (discarding edges of the bouncing)
+	TCCR0 = 0;
+	GIFR = (1<<INTF1);
+	GICR |= (1<<INT1);
+}
+
+
+/**
+ * @brief Configure the button input and enable its interrupt
+ *
+ * This has to be called before pwmInit(), which keeps the pull-up of PD3 enabled when it writes the
+ * LED ports.
+ */
+void buttonInit( void )
+{
+	// input with pull-up
+	DDRD &= ~(1<<PD3);
+	PORTD |= (1<<PD3);
+
+	TIMSK |= (1<<TOIE0);
+
+	// interrupt on falling edge
+	MCUCR = ( MCUCR & ~( (1<<ISC11) | (1<<ISC10) ) ) | (1<<ISC11);
+	GIFR = (1<<INTF1);
+	GICR |= (1<<INT1);
+}
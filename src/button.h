@@ -0,0 +1,13 @@
+#ifndef BUTTON_H_
+#define BUTTON_H_
+
+#include <inttypes.h>
+
+
+// set by the interrupt handler when the button has been pressed, to be cleared by the main program
+extern volatile uint8_t g_buttonPressed;
+
+void buttonInit( void );
+
+
+#endif // BUTTON_H_
@@ -0,0 +1,62 @@
+#ifndef COROUTINE_H_
+#define COROUTINE_H_
+
+/**
+ * Stackless coroutines (see http://www.chiark.greenend.org.uk/~sgtatham/coroutines.html)
+ *
+ * An animation program is written as straight-line code that yields after drawing each frame. The
+ * body of the program is wrapped in a switch statement on the coroutine state, which stores where
+ * the program yielded. Resuming the program jumps right behind the last CR_YIELD().
+ *
+ *     uint8_t Foo_execute( FooProgram* prog )
+ *     {
+ *         CR_BEGIN( prog->cr );
+ *
+ *         for( prog->i = 0; prog->i < 10; prog->i++ )
+ *         {
+ *             setPixel( ... );
+ *             CR_YIELD( prog->cr, prog->i == 9 );
+ *         }
+ *
+ *         CR_END( prog->cr );
+ *     }
+ *
+ * Restrictions:
+ *
+ * - Local variables do not survive a CR_YIELD(). Everything that is needed after yielding must be
+ *   stored in the program's state.
+ * - CR_YIELD() must not be used inside a switch statement of the program body.
+ *
+ * The state is a single byte per program. CR_YIELD() takes its resume point from __COUNTER__, so
+ * there may be at most 255 yields per translation unit.
+ */
+
+#include <inttypes.h>
+
+
+typedef uint8_t coroutine_t;
+
+
+// reset the coroutine: the next resume starts at the top of the body
+#define CR_INIT( cr ) ( ( cr ) = 0 )
+
+// start of the body
+#define CR_BEGIN( cr ) switch( cr ) { case 0:
+
+// return ret to the caller, resume right here the next time
+#define CR_YIELD( cr, ret ) CR_YIELD_( cr, ret, __COUNTER__ + 1 )
+
+#define CR_YIELD_( cr, ret, resumePoint ) \
+	do                                    \
+	{                                     \
+		( cr ) = ( resumePoint );         \
+		return ( ret );                   \
+		case ( resumePoint ):;            \
+	}                                     \
+	while( 0 )
+
+// end of the body: return 1 to the caller, start again at the top the next time
+#define CR_END( cr ) } ( cr ) = 0; return 1
+
+
+#endif // COROUTINE_H_
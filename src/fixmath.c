@@ -0,0 +1,189 @@
+#include "fixmath.h"
+
+#include <avr/pgmspace.h>
+
+
+// first quarter of a sine wave with an amplitude of 127: round( 127 * sin( i * 2 pi / 256 ) ) for
+// i = 0 - 64 (the other quarters are mirrored)
+static uint8_t const g_quarterSine[ 65 ] PROGMEM =
+{
+	  0,   3,   6,   9,  12,  16,  19,  22,  25,  28,  31,  34,  37,  40,  43,  46,
+	 49,  51,  54,  57,  60,  63,  65,  68,  71,  73,  76,  78,  81,  83,  85,  88,
+	 90,  92,  94,  96,  98, 100, 102, 104, 106, 107, 109, 111, 112, 113, 115, 116,
+	117, 118, 120, 121, 122, 122, 123, 124, 125, 125, 126, 126, 126, 127, 127, 127,
+	127,
+};
+
+
+// levels of the red, green and blue channel in fxHsv()
+enum
+{
+	HSV_V, // maximum (the value)
+	HSV_P, // minimum
+	HSV_Q, // falling from maximum to minimum within a sixth of the color wheel
+	HSV_T, // rising from minimum to maximum
+};
+
+#define HSV_LEVELS( r, g, b ) ( ( r ) | ( ( g ) << 2 ) | ( ( b ) << 4 ) )
+
+// levels of the channels in each sixth of the color wheel (2 bits per channel)
+static uint8_t const g_hueSixths[ 6 ] PROGMEM =
+{
+	HSV_LEVELS( HSV_V, HSV_T, HSV_P ), // red to yellow
+	HSV_LEVELS( HSV_Q, HSV_V, HSV_P ), // yellow to green
+	HSV_LEVELS( HSV_P, HSV_V, HSV_T ), // green to cyan
+	HSV_LEVELS( HSV_P, HSV_Q, HSV_V ), // cyan to blue
+	HSV_LEVELS( HSV_T, HSV_P, HSV_V ), // blue to magenta
+	HSV_LEVELS( HSV_V, HSV_P, HSV_Q ), // magenta to red
+};
+
+
+uint8_t fxScale( uint8_t v, uint8_t s )
+{
+	// v * ( s + 1 ) / 256, which is exact for s = 0 and s = 255
+	return ( v * s + v ) >> 8;
+}
+
+
+uint8_t fxLerp( uint8_t a, uint8_t b, uint8_t t )
+{
+	if( b >= a )
+	{
+		return a + fxScale( b - a, t );
+	}
+	else
+	{
+		return a - fxScale( a - b, t );
+	}
+}
+
+
+uint8_t fxTriangle( uint8_t x, uint8_t peak )
+{
+	if( x < peak )
+	{
+		return x;
+	}
+	else
+	{
+		return 2 * peak - x;
+	}
+}
+
+
+uint8_t fxSine( uint8_t phase )
+{
+	uint8_t i = phase & 63;
+
+	// falling quarters (2nd and 4th) are the rising ones mirrored
+	if( phase & 64 )
+	{
+		i = 64 - i;
+	}
+
+	uint8_t v = pgm_read_byte( &g_quarterSine[ i ] );
+
+	// negative half-wave (3rd and 4th quarter)
+	if( phase & 128 )
+	{
+		return 128 - v;
+	}
+	else
+	{
+		return 128 + v;
+	}
+}
+
+
+uint8_t fxEaseIn( uint8_t t )
+{
+	// t^2
+	return fxScale( t, t );
+}
+
+
+uint8_t fxEaseOut( uint8_t t )
+{
+	// 1 - ( 1 - t )^2
+	return 255 - fxEaseIn( 255 - t );
+}
+
+
+uint8_t fxEaseInOut( uint8_t t )
+{
+	// half a cosine wave, ( 1 - cos( pi * t ) ) / 2, taken from the sine table at half resolution
+	uint8_t i = t >> 1;
+
+	if( i < 64 )
+	{
+		return 127 - pgm_read_byte( &g_quarterSine[ 64 - i ] );
+	}
+	else
+	{
+		return 128 + pgm_read_byte( &g_quarterSine[ i - 64 ] );
+	}
+}
+
+
+void fxHsv( uint8_t h, uint8_t s, uint8_t v, uint8_t* rgb )
+{
+	// h * 6 / 256 is the sixth of the color wheel, the low byte the position within it (this
+	// needs a single multiplication instead of a division)
+	uint16_t x = h * 6;
+	uint8_t f = x & 0xff;
+	uint8_t level[ 4 ];
+
+	level[ HSV_V ] = v;
+	level[ HSV_P ] = fxScale( v, 255 - s );
+	level[ HSV_Q ] = fxScale( v, 255 - fxScale( s, f ) );
+	level[ HSV_T ] = fxScale( v, 255 - fxScale( s, 255 - f ) );
+
+	uint8_t levels = pgm_read_byte( &g_hueSixths[ x >> 8 ] );
+
+	rgb[ 0 ] = level[ levels & 3 ];
+	rgb[ 1 ] = level[ ( levels >> 2 ) & 3 ];
+	rgb[ 2 ] = level[ levels >> 4 ];
+}
+
+
+uint16_t fxRandom( uint16_t* state )
+{
+	// shifts ( 7, 9, 8 ) give the full period, the last one is a byte move
+	uint16_t x = *state;
+
+	x ^= x << 7;
+	x ^= x >> 9;
+	x ^= x << 8;
+
+	*state = x;
+
+	return x;
+}
+
+
+void fxNoiseInit( fxNoise_t* noise, uint16_t seed )
+{
+	noise->random = seed;
+	noise->from = 0;
+	noise->to = fxRandom( &noise->random ) >> 8;
+
+	// the first step passes the lattice point, so the noise starts at the value drawn there
+	noise->phase = 255;
+}
+
+
+uint8_t fxNoise( fxNoise_t* noise, uint8_t step )
+{
+	uint8_t phase = noise->phase + step;
+
+	// passed the next lattice point
+	if( phase < noise->phase )
+	{
+		noise->from = noise->to;
+		noise->to = fxRandom( &noise->random ) >> 8;
+	}
+
+	noise->phase = phase;
+
+	return fxLerp( noise->from, noise->to, fxEaseInOut( phase ) );
+}
@@ -0,0 +1,67 @@
+#ifndef FIXMATH_H_
+#define FIXMATH_H_
+
+/**
+ * Fixed-point math for the animations
+ *
+ * All functions work on 8 bit unsigned values without floating-point math and without division
+ * (the ATmega8 has neither, both end up as slow library calls). Fractions are expressed as
+ * 0 - 255, where 255 means 1. Periodic functions take a phase of 0 - 255 for a complete period,
+ * so advancing the phase simply wraps around.
+ *
+ * The cycle counts are estimates for avr-gcc -Os on the ATmega8, including call and return.
+ * 'make bench' measures the exact numbers of the functions in BENCHFUNCS (see the Makefile).
+ */
+
+#include <inttypes.h>
+
+
+// v * s (s = 0 - 255 for 0 - 1, i.e. fxScale( v, 255 ) == v), ca. 15 cycles
+uint8_t fxScale( uint8_t v, uint8_t s );
+
+// linear interpolation from a (t = 0) to b (t = 255), ca. 20 cycles
+uint8_t fxLerp( uint8_t a, uint8_t b, uint8_t t );
+
+// triangle wave rising from 0 (x = 0) to peak (x = peak) and falling back to 0 (x = 2 * peak),
+// x must be less than 2 * peak, ca. 15 cycles
+uint8_t fxTriangle( uint8_t x, uint8_t peak );
+
+// sine wave between 1 and 255: 128 at phase 0, 255 at phase 64, 1 at phase 192, ca. 30 cycles
+uint8_t fxSine( uint8_t phase );
+
+// easing curves from 0 (t = 0) to 255 (t = 255): slow start (quadratic), slow end (quadratic) and
+// both (cosine), ca. 15, 20 and 25 cycles
+uint8_t fxEaseIn( uint8_t t );
+uint8_t fxEaseOut( uint8_t t );
+uint8_t fxEaseInOut( uint8_t t );
+
+// color of the hue h (0 - 255 for a complete turn of the color wheel: red at 0, yellow, green at
+// 85, cyan, blue at 171, magenta) with the saturation s (0 - 255) and the value v, as red, green
+// and blue (0 - v each, so v = MAX_INTENSITY yields LED intensities), ca. 120 cycles
+void fxHsv( uint8_t h, uint8_t s, uint8_t v, uint8_t* rgb );
+
+// next pseudo-random number of a 16 bit xorshift generator (period 65535, the state must not be 0),
+// ca. 25 cycles
+uint16_t fxRandom( uint16_t* state );
+
+// Smoothed value noise: random values (0 - 255) at every 256 steps of the position, eased in
+// between (see fxNoise()). Each noise has its own generator, so its values only depend on the sum
+// of its steps, not on how they are split up.
+typedef struct
+{
+	uint16_t random; // state of fxRandom()
+	uint8_t from;    // value at the last lattice point
+	uint8_t to;      // value at the next lattice point
+	uint8_t phase;   // position between them
+}
+fxNoise_t;
+
+// start a noise at a random value, seed must not be 0
+void fxNoiseInit( fxNoise_t* noise, uint16_t seed );
+
+// advance the noise by step (0 - 255, the higher the faster it changes) and return its value,
+// ca. 50 cycles (plus fxRandom() at a lattice point)
+uint8_t fxNoise( fxNoise_t* noise, uint8_t step );
+
+
+#endif // FIXMATH_H_
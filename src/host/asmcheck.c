@@ -0,0 +1,318 @@
+/**
+ * Host (PC) check of the PWM interrupt handler built for the ATmega8
+ *
+ * This runs pwm.c as built for the ATmega8 (an ELF file, see asmcheck in the Makefile) in the
+ * instruction set interpreter of avrcore.c, next to pwm.c built for the PC as the reference, and
+ * checks that the interrupt handler of PWM_ENGINE_STEP produces the same outputs. With the
+ * assembly version of the handler (PWM_ASM, see pwmisr.S), this is the check that it is
+ * equivalent to the C version.
+ *
+ * Both get the same series of random frames (see pwmcheck.c). For each PWM step, the handler is
+ * executed on both (if the timer runs), followed by pwmDither() as called by the main loop, and
+ * PORTB, PORTC and PORTD have to match afterwards. The handler must preserve all registers it
+ * does not own (all but r2 - r9 with PWM_ASM), the SREG and the stack pointer, which are set to
+ * random values before each call.
+ *
+ * The cycles of each call of the handler are counted, including the interrupt response (4) and the
+ * rjmp in the vector table (2). The report gives their minimum, average and maximum.
+ */
+
+#include "avrcore.h"
+#include "pwm.h"
+
+#include <avr/interrupt.h>
+#include <avr/io.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+#if PWM_ENGINE != PWM_ENGINE_STEP || PWM_OUTPUT != PWM_OUTPUT_PINS
+#error "the check is for the interrupt handler of PWM_ENGINE_STEP with PWM_OUTPUT_PINS"
+#endif
+
+#define NUM_CHANNELS ( 3 * NUM_PIXELS )
+
+#define NUM_FRAMES 200
+
+// PWM cycles to run each frame for (plus up to one more, so the updates come at random steps)
+#define FRAME_CYCLES ( 2 * ( 1 << PWM_DITHER_BITS ) + 2 )
+
+// clock select bits of timer 2 (0: stopped)
+#define TIMER_CLOCK ( (1<<CS22) | (1<<CS21) | (1<<CS20) )
+
+// values of the pins that do not drive LEDs, before pwmInit()
+#define IDLE_PORTB 0xc0
+#define IDLE_PORTC 0x38
+#define IDLE_PORTD 0x18
+
+// data addresses of the I/O registers on the ATmega8
+#define AVR_PORTB 0x38
+#define AVR_PORTC 0x35
+#define AVR_PORTD 0x32
+#define AVR_TCCR2 0x45
+#define AVR_TIMSK 0x59
+
+// the duty cycles passed to pwmUpdate() on the ATmega8, at the end of the SRAM (below the stack)
+#define AVR_DUTY ( AVR_DATA_SIZE - sizeof( ledDuty_t ) * NUM_PIXELS )
+#define AVR_STACK ( AVR_DUTY - 1 )
+
+// the registers of the assembly interrupt handler (see pwmregs.h)
+#define FIRST_ASM_REG 2
+#define LAST_ASM_REG 9
+
+
+// simulated I/O registers of the reference (see avr/io.h) -----------------------------------------
+
+volatile uint8_t PORTB, DDRB;
+volatile uint8_t PORTC, DDRC;
+volatile uint8_t PORTD, DDRD;
+volatile uint8_t TCCR2, TCNT2, OCR2;
+volatile uint8_t TIMSK, TIFR;
+volatile uint8_t SPCR;
+
+volatile uint8_t* hostSpiData( void )
+{
+	static volatile uint8_t data;
+	return &data;
+}
+
+volatile uint8_t* hostSpiStatus( void )
+{
+	static volatile uint8_t status;
+	return &status;
+}
+
+void TIMER2_COMP_vect( void );
+
+
+// ATmega8 ---------------------------------------------------------------------------------------
+
+static avrCore_t g_avr;
+
+// functions of the firmware
+static uint32_t g_pwmInit;
+static uint32_t g_pwmUpdate;
+static uint32_t g_pwmDither;
+static uint32_t g_vector;
+
+// with the assembly interrupt handler
+static uint8_t g_asm;
+
+// cycles of the interrupt handler
+static unsigned long g_calls;
+static uint64_t g_totalCycles;
+static uint32_t g_minCycles = UINT32_MAX;
+static uint32_t g_maxCycles;
+
+
+static uint32_t random32( void )
+{
+	// xorshift32 (the same sequence on every host)
+	static uint32_t state = 0x2545f491;
+
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+	return state;
+}
+
+
+static uint32_t symbol( char const* name )
+{
+	uint32_t address;
+
+	if( !avrSymbol( &g_avr, name, &address ) )
+	{
+		fprintf( stderr, "no symbol %s\n", name );
+		exit( 1 );
+	}
+
+	return address;
+}
+
+
+// call a function of the firmware (avr-gcc expects r1 to be 0)
+static uint16_t call( uint32_t address, uint16_t arg )
+{
+	g_avr.data[ 1 ] = 0;
+	return avrCall( &g_avr, address, arg );
+}
+
+
+/**
+ * @brief Execute the interrupt handler on the ATmega8, with random values in the other registers
+ */
+static void interrupt( void )
+{
+	uint8_t before[ 32 + 3 ];
+	uint8_t after[ 32 + 3 ];
+	uint32_t cycles;
+	uint8_t i;
+
+	for( i = 0; i < 32; i++ )
+	{
+		if( !g_asm || i < FIRST_ASM_REG || i > LAST_ASM_REG )
+		{
+			g_avr.data[ i ] = random32();
+		}
+	}
+
+	// interrupts are enabled (the handler's reti enables them again)
+	g_avr.data[ AVR_SREG ] = random32() | AVR_SREG_I;
+
+	memcpy( before, g_avr.data, 32 );
+	before[ 32 ] = g_avr.data[ AVR_SREG ];
+	before[ 33 ] = g_avr.data[ AVR_SPL ];
+	before[ 34 ] = g_avr.data[ AVR_SPH ];
+
+	cycles = avrInterrupt( &g_avr, g_vector );
+
+	memcpy( after, g_avr.data, 32 );
+	after[ 32 ] = g_avr.data[ AVR_SREG ];
+	after[ 33 ] = g_avr.data[ AVR_SPL ];
+	after[ 34 ] = g_avr.data[ AVR_SPH ];
+
+	if( g_asm )
+	{
+		memcpy( after + FIRST_ASM_REG, before + FIRST_ASM_REG, LAST_ASM_REG - FIRST_ASM_REG + 1 );
+	}
+
+	if( memcmp( before, after, sizeof( before ) ) != 0 )
+	{
+		fprintf( stderr, "the interrupt handler changed registers, the SREG or the SP\n" );
+		exit( 1 );
+	}
+
+	g_calls += 1;
+	g_totalCycles += cycles;
+	if( cycles < g_minCycles ) { g_minCycles = cycles; }
+	if( cycles > g_maxCycles ) { g_maxCycles = cycles; }
+}
+
+
+// check -------------------------------------------------------------------------------------------
+
+static void compare( unsigned long step )
+{
+	uint8_t const* io = g_avr.data;
+
+	if( io[ AVR_PORTB ] != PORTB || io[ AVR_PORTC ] != PORTC || io[ AVR_PORTD ] != PORTD ||
+	    !( io[ AVR_TCCR2 ] & TIMER_CLOCK ) != !( TCCR2 & TIMER_CLOCK ) )
+	{
+		fprintf( stderr, "step %lu: ports %02x %02x %02x (timer %s), expected %02x %02x %02x "
+		         "(timer %s)\n", step, io[ AVR_PORTB ], io[ AVR_PORTC ], io[ AVR_PORTD ],
+		         io[ AVR_TCCR2 ] & TIMER_CLOCK ? "on" : "off", PORTB, PORTC, PORTD,
+		         TCCR2 & TIMER_CLOCK ? "on" : "off" );
+		exit( 1 );
+	}
+}
+
+
+// random duty cycles (see pwmcheck.c)
+static void randomFrame( int frame, ledDuty_t* pixels )
+{
+	pwmDuty_t* duty = &pixels[ 0 ].r;
+	uint8_t dimmed = 0;
+	uint8_t i;
+
+	for( i = 0; i < NUM_CHANNELS; i++ )
+	{
+		uint32_t const r = random32();
+
+		if( frame % 5 == 4 )
+		{
+			duty[ i ] = r % 2 ? PWM_MAX_DUTY : 0;
+			continue;
+		}
+
+		switch( r % 8 )
+		{
+			case 0:  duty[ i ] = 0; break;
+			case 1:  duty[ i ] = PWM_MAX_DUTY; break;
+			case 2:  duty[ i ] = (pwmDuty_t) ~0; break;
+			case 3:  duty[ i ] = i > 0 ? duty[ i - 1 ] : 1; break;
+			default: duty[ i ] = 1 + ( r >> 8 ) % ( PWM_MAX_DUTY - 1 ); dimmed = 1; break;
+		}
+	}
+
+	if( frame % 5 != 4 && !dimmed )
+	{
+		duty[ 0 ] = PWM_MAX_DUTY / 2;
+	}
+}
+
+
+int main( int argc, char** argv )
+{
+	ledDuty_t pixels[ NUM_PIXELS ];
+	unsigned long step = 0;
+	uint32_t address;
+	int frame;
+
+	if( argc != 2 )
+	{
+		fprintf( stderr, "usage: %s firmware.out\n", argv[ 0 ] );
+		return 1;
+	}
+
+	if( !avrLoad( &g_avr, argv[ 1 ] ) )
+	{
+		return 1;
+	}
+
+	g_pwmInit = symbol( "pwmInit" );
+	g_pwmUpdate = symbol( "pwmUpdate" );
+	g_pwmDither = symbol( "pwmDither" );
+	g_vector = symbol( "__vector_3" );
+	g_asm = avrSymbol( &g_avr, "pwmBeginCycle", &address );
+
+	g_avr.data[ AVR_SPL ] = AVR_STACK & 0xff;
+	g_avr.data[ AVR_SPH ] = AVR_STACK >> 8;
+
+	PORTB = g_avr.data[ AVR_PORTB ] = IDLE_PORTB;
+	PORTC = g_avr.data[ AVR_PORTC ] = IDLE_PORTC;
+	PORTD = g_avr.data[ AVR_PORTD ] = IDLE_PORTD;
+
+	pwmInit();
+	call( g_pwmInit, 0 );
+	compare( step );
+
+	for( frame = 0; frame < NUM_FRAMES; frame++ )
+	{
+		unsigned long steps = FRAME_CYCLES * 256 + random32() % 256;
+
+		randomFrame( frame, pixels );
+
+		// the duty cycles are little endian on both
+		memcpy( g_avr.data + AVR_DUTY, pixels, sizeof( pixels ) );
+		call( g_pwmUpdate, AVR_DUTY );
+		pwmUpdate( pixels );
+
+		while( steps-- > 0 )
+		{
+			if( TCCR2 & TIMER_CLOCK )
+			{
+				TIMER2_COMP_vect();
+			}
+
+			if( ( g_avr.data[ AVR_TCCR2 ] & TIMER_CLOCK ) &&
+			    ( g_avr.data[ AVR_TIMSK ] & (1<<OCIE2) ) )
+			{
+				interrupt();
+			}
+
+			pwmDither();
+			call( g_pwmDither, 0 );
+
+			compare( ++step );
+		}
+	}
+
+	printf( "TIMER2_COMP_vect (%s): %lu calls, %lu / %.1f / %lu cycles (min / avg / max)\n",
+	        g_asm ? "assembly" : "C", g_calls, (unsigned long) g_minCycles,
+	        (double) g_totalCycles / g_calls, (unsigned long) g_maxCycles );
+
+	return 0;
+}
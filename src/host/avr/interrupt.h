@@ -0,0 +1,9 @@
+#ifndef HOST_AVR_INTERRUPT_H_
+#define HOST_AVR_INTERRUPT_H_
+
+// Stand-in for avr-libc's <avr/interrupt.h> on the PC: an interrupt handler is a plain function,
+// which the host program calls whenever the interrupt would fire (see pwmcheck.c).
+
+#define ISR( vector ) void vector( void ); void vector( void )
+
+#endif // HOST_AVR_INTERRUPT_H_
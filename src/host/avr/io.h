@@ -0,0 +1,53 @@
+#ifndef HOST_AVR_IO_H_
+#define HOST_AVR_IO_H_
+
+// Stand-in for avr-libc's <avr/io.h> on the PC, with the I/O registers and bits used by pwm.c. The
+// registers are plain variables, which the host program defines and inspects (see pwmcheck.c).
+// The SPI completes each transfer at once: SPDR appends the byte to the burst returned by
+// hostSpiData(), and SPSR always has SPIF set.
+
+#include <inttypes.h>
+
+extern volatile uint8_t PORTB, DDRB;
+extern volatile uint8_t PORTC, DDRC;
+extern volatile uint8_t PORTD, DDRD;
+extern volatile uint8_t TCCR2, TCNT2, OCR2;
+extern volatile uint8_t TIMSK, TIFR;
+extern volatile uint8_t SPCR;
+
+volatile uint8_t* hostSpiData( void );
+volatile uint8_t* hostSpiStatus( void );
+
+#define SPDR ( *hostSpiData() )
+#define SPSR ( *hostSpiStatus() )
+
+#define PB0 0
+#define PB1 1
+#define PB2 2
+#define PB3 3
+#define PB4 4
+#define PB5 5
+#define PC0 0
+#define PC1 1
+#define PC2 2
+#define PD0 0
+#define PD1 1
+#define PD2 2
+#define PD5 5
+#define PD6 6
+#define PD7 7
+
+#define CS20 0
+#define CS21 1
+#define CS22 2
+#define WGM21 3
+#define TOIE2 6
+#define OCIE2 7
+#define OCF2 7
+
+#define SPI2X 0
+#define MSTR 4
+#define SPE 6
+#define SPIF 7
+
+#endif // HOST_AVR_IO_H_
@@ -0,0 +1,17 @@
+#ifndef HOST_AVR_PGMSPACE_H_
+#define HOST_AVR_PGMSPACE_H_
+
+// Stand-in for avr-libc's <avr/pgmspace.h> on the PC, where there is only a single address space.
+
+#include <inttypes.h>
+#include <string.h>
+
+#define PROGMEM
+
+#define pgm_read_byte( addr ) ( *(uint8_t const*) ( addr ) )
+#define pgm_read_word( addr ) ( *(uint16_t const*) ( addr ) )
+#define pgm_read_ptr( addr )  ( *(void* const*) ( addr ) )
+
+#define memcpy_P( dest, src, n ) memcpy( ( dest ), ( src ), ( n ) )
+
+#endif // HOST_AVR_PGMSPACE_H_
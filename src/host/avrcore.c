@@ -0,0 +1,850 @@
+/**
+ * Instruction set interpreter of the ATmega8 core
+ *
+ * This executes firmware built for the ATmega8 on the PC, one instruction at a time, and counts
+ * the CPU cycles as given by the instruction set manual (AVRe core). It is meant for running
+ * single functions and interrupt handlers of an ELF file (see avrCall() and avrInterrupt()), so
+ * there is no startup code: avrLoad() copies the initialized data to the SRAM and clears the rest.
+ * There are no peripherals and no interrupt sources, the I/O registers are plain memory.
+ *
+ * Any access outside of the flash and the data space, an unknown instruction and the sleep
+ * instruction make the interpreter abort, they are always a bug of the code under test.
+ */
+
+#include "avrcore.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+// flags of the SREG
+#define SREG_C 0x01
+#define SREG_Z 0x02
+#define SREG_N 0x04
+#define SREG_V 0x08
+#define SREG_S 0x10
+#define SREG_H 0x20
+#define SREG_T 0x40
+
+// pseudo return address which ends avrCall() and avrInterrupt() (outside of the flash)
+#define RETURN_ADDRESS 0xffff
+
+// maximum number of cycles of a single avrCall() or avrInterrupt()
+#define MAX_CALL_CYCLES 10000000
+
+
+static void fault( avrCore_t const* avr, char const* what )
+{
+	fprintf( stderr, "AVR: %s at 0x%04x\n", what, (unsigned) avr->pc * 2 );
+	exit( 1 );
+}
+
+
+// ELF file ----------------------------------------------------------------------------------------
+
+static uint32_t elf16( avrCore_t const* avr, long offset )
+{
+	if( offset < 0 || offset + 2 > avr->elfSize )
+	{
+		fault( avr, "truncated ELF file" );
+	}
+
+	return avr->elf[ offset ] | avr->elf[ offset + 1 ] << 8;
+}
+
+static uint32_t elf32( avrCore_t const* avr, long offset )
+{
+	return elf16( avr, offset ) | elf16( avr, offset + 2 ) << 16;
+}
+
+
+/**
+ * @brief Load the flash and the initialized data of an ELF file
+ *
+ * The registers are cleared, the stack pointer is set to the end of the SRAM.
+ */
+int avrLoad( avrCore_t* avr, char const* path )
+{
+	FILE* f = fopen( path, "rb" );
+	uint32_t ph;
+	uint32_t i;
+
+	memset( avr, 0, sizeof( *avr ) );
+
+	if( !f )
+	{
+		perror( path );
+		return 0;
+	}
+
+	fseek( f, 0, SEEK_END );
+	avr->elfSize = ftell( f );
+	fseek( f, 0, SEEK_SET );
+	avr->elf = malloc( avr->elfSize );
+
+	if( fread( avr->elf, 1, avr->elfSize, f ) != (size_t) avr->elfSize ||
+	    avr->elfSize < 52 || memcmp( avr->elf, "\177ELF\001\001", 6 ) != 0 ||
+	    elf16( avr, 18 ) != 83 )
+	{
+		fprintf( stderr, "%s: not an AVR ELF file\n", path );
+		fclose( f );
+		return 0;
+	}
+
+	fclose( f );
+
+	// loadable segments: the flash, and the data space from 0x800000 on
+	ph = elf32( avr, 28 );
+	for( i = 0; i < elf16( avr, 44 ); i++, ph += elf16( avr, 42 ) )
+	{
+		uint32_t const offset = elf32( avr, ph + 4 );
+		uint32_t const address = elf32( avr, ph + 8 );
+		uint32_t const fileSize = elf32( avr, ph + 16 );
+		uint32_t const memorySize = elf32( avr, ph + 20 );
+		uint8_t* target;
+		uint32_t size;
+
+		if( elf32( avr, ph ) != 1 || memorySize == 0 )
+		{
+			continue;
+		}
+
+		if( address >= 0x800000 )
+		{
+			target = avr->data + ( address - 0x800000 );
+			size = AVR_DATA_SIZE - ( address - 0x800000 );
+		}
+		else
+		{
+			target = (uint8_t*) avr->flash + address;
+			size = sizeof( avr->flash ) - address;
+		}
+
+		if( memorySize > size || fileSize > memorySize || offset + fileSize > avr->elfSize )
+		{
+			fprintf( stderr, "%s: segment at 0x%x does not fit\n", path, address );
+			return 0;
+		}
+
+		memcpy( target, avr->elf + offset, fileSize );
+	}
+
+	// the flash holds little endian words
+	for( i = 0; i < AVR_FLASH_WORDS; i++ )
+	{
+		uint8_t const* word = (uint8_t const*) &avr->flash[ i ];
+		avr->flash[ i ] = word[ 0 ] | word[ 1 ] << 8;
+	}
+
+	avr->data[ AVR_SPL ] = ( AVR_DATA_SIZE - 1 ) & 0xff;
+	avr->data[ AVR_SPH ] = ( AVR_DATA_SIZE - 1 ) >> 8;
+
+	return 1;
+}
+
+
+/**
+ * @brief Look up the address of a symbol of the ELF file (in bytes, in the flash or the data space)
+ *
+ * Returns whether the symbol is defined.
+ */
+int avrSymbol( avrCore_t const* avr, char const* name, uint32_t* address )
+{
+	uint32_t const sections = elf32( avr, 32 );
+	uint32_t const sectionSize = elf16( avr, 46 );
+	uint32_t i;
+
+	for( i = 0; i < elf16( avr, 48 ); i++ )
+	{
+		uint32_t const section = sections + i * sectionSize;
+		uint32_t const strings = sections + elf32( avr, section + 24 ) * sectionSize;
+		uint32_t symbol;
+
+		// SHT_SYMTAB
+		if( elf32( avr, section + 4 ) != 2 )
+		{
+			continue;
+		}
+
+		for( symbol = elf32( avr, section + 16 );
+		     symbol < elf32( avr, section + 16 ) + elf32( avr, section + 20 ); symbol += 16 )
+		{
+			long const offset = elf32( avr, strings + 16 ) + elf32( avr, symbol );
+
+			// defined (not SHN_UNDEF), with the name
+			if( elf16( avr, symbol + 14 ) != 0 && offset < avr->elfSize &&
+			    strncmp( (char const*) avr->elf + offset, name, avr->elfSize - offset ) == 0 )
+			{
+				*address = elf32( avr, symbol + 4 );
+				return 1;
+			}
+		}
+	}
+
+	return 0;
+}
+
+
+// data space --------------------------------------------------------------------------------------
+
+static uint8_t* data( avrCore_t* avr, uint32_t address )
+{
+	if( address >= AVR_DATA_SIZE )
+	{
+		fault( avr, "data access out of range" );
+	}
+
+	return &avr->data[ address ];
+}
+
+static uint16_t sp( avrCore_t const* avr )
+{
+	return avr->data[ AVR_SPL ] | avr->data[ AVR_SPH ] << 8;
+}
+
+static void setSp( avrCore_t* avr, uint16_t value )
+{
+	avr->data[ AVR_SPL ] = value & 0xff;
+	avr->data[ AVR_SPH ] = value >> 8;
+}
+
+static void push( avrCore_t* avr, uint8_t value )
+{
+	*data( avr, sp( avr ) ) = value;
+	setSp( avr, sp( avr ) - 1 );
+}
+
+static uint8_t pop( avrCore_t* avr )
+{
+	setSp( avr, sp( avr ) + 1 );
+	return *data( avr, sp( avr ) );
+}
+
+static void pushPc( avrCore_t* avr, uint32_t pc )
+{
+	push( avr, pc & 0xff );
+	push( avr, pc >> 8 );
+}
+
+static uint32_t popPc( avrCore_t* avr )
+{
+	uint32_t pc = pop( avr ) << 8;
+	return pc | pop( avr );
+}
+
+static uint16_t pair( avrCore_t const* avr, uint8_t r )
+{
+	return avr->data[ r ] | avr->data[ r + 1 ] << 8;
+}
+
+static void setPair( avrCore_t* avr, uint8_t r, uint16_t value )
+{
+	avr->data[ r ] = value & 0xff;
+	avr->data[ r + 1 ] = value >> 8;
+}
+
+
+// flags -------------------------------------------------------------------------------------------
+
+static void setFlags( avrCore_t* avr, uint8_t mask, uint8_t flags )
+{
+	uint8_t* sreg = &avr->data[ AVR_SREG ];
+
+	// S = N ^ V
+	if( mask & ( SREG_N | SREG_V ) )
+	{
+		mask |= SREG_S;
+		flags |= ( !( flags & SREG_N ) != !( flags & SREG_V ) ) ? SREG_S : 0;
+	}
+
+	*sreg = ( *sreg & ~mask ) | ( flags & mask );
+}
+
+static uint8_t flag( avrCore_t const* avr, uint8_t mask )
+{
+	return ( avr->data[ AVR_SREG ] & mask ) != 0;
+}
+
+// N and Z of a result
+static uint8_t nz( uint8_t r )
+{
+	return ( r & 0x80 ? SREG_N : 0 ) | ( r == 0 ? SREG_Z : 0 );
+}
+
+static uint8_t add( avrCore_t* avr, uint8_t d, uint8_t r, uint8_t carry )
+{
+	uint8_t const result = d + r + carry;
+	uint8_t const carries = ( d & r ) | ( r & ~result ) | ( ~result & d );
+
+	setFlags( avr, SREG_H | SREG_V | SREG_N | SREG_Z | SREG_C,
+	          ( carries & 0x08 ? SREG_H : 0 ) | ( carries & 0x80 ? SREG_C : 0 ) |
+	          ( ( ( d & r & ~result ) | ( ~d & ~r & result ) ) & 0x80 ? SREG_V : 0 ) |
+	          nz( result ) );
+	return result;
+}
+
+// subtraction (keepZ: Z stays cleared for a non-zero result, for multi-byte comparisons)
+static uint8_t sub( avrCore_t* avr, uint8_t d, uint8_t r, uint8_t carry, uint8_t keepZ )
+{
+	uint8_t const result = d - r - carry;
+	uint8_t const borrows = ( ~d & r ) | ( r & result ) | ( result & ~d );
+	uint8_t flags = ( borrows & 0x08 ? SREG_H : 0 ) | ( borrows & 0x80 ? SREG_C : 0 ) |
+	                ( ( ( d & ~r & ~result ) | ( ~d & r & result ) ) & 0x80 ? SREG_V : 0 ) |
+	                nz( result );
+
+	if( keepZ && !flag( avr, SREG_Z ) )
+	{
+		flags &= ~SREG_Z;
+	}
+
+	setFlags( avr, SREG_H | SREG_V | SREG_N | SREG_Z | SREG_C, flags );
+	return result;
+}
+
+static uint8_t logic( avrCore_t* avr, uint8_t result )
+{
+	setFlags( avr, SREG_V | SREG_N | SREG_Z, nz( result ) );
+	return result;
+}
+
+// flags of the right shifts (the result and the bit shifted out)
+static uint8_t shiftRight( avrCore_t* avr, uint8_t result, uint8_t carry )
+{
+	uint8_t const flags = nz( result ) | ( carry ? SREG_C : 0 );
+
+	setFlags( avr, SREG_V | SREG_N | SREG_Z | SREG_C,
+	          flags | ( !( flags & SREG_N ) != !carry ? SREG_V : 0 ) );
+	return result;
+}
+
+// flags of the multiplications (fractional: shifted left by one)
+static void multiply( avrCore_t* avr, int32_t product, uint8_t fractional )
+{
+	uint16_t result = product;
+
+	setFlags( avr, SREG_C, result & 0x8000 ? SREG_C : 0 );
+
+	if( fractional )
+	{
+		result <<= 1;
+	}
+
+	setFlags( avr, SREG_Z, result == 0 ? SREG_Z : 0 );
+	setPair( avr, 0, result );
+}
+
+
+// instructions ------------------------------------------------------------------------------------
+
+static uint16_t fetch( avrCore_t* avr )
+{
+	if( avr->pc >= AVR_FLASH_WORDS )
+	{
+		fault( avr, "jump out of the flash" );
+	}
+
+	return avr->flash[ avr->pc++ ];
+}
+
+// whether an instruction takes two words (jmp, call, lds, sts)
+static uint8_t isTwoWords( uint16_t op )
+{
+	return ( op & 0xfc0f ) == 0x9000 || ( op & 0xfe0c ) == 0x940c;
+}
+
+// skip the next instruction (for cpse, sbrc, sbrs, sbic and sbis)
+static void skip( avrCore_t* avr )
+{
+	uint16_t const next = fetch( avr );
+
+	avr->cycles += 1;
+
+	if( isTwoWords( next ) )
+	{
+		avr->pc += 1;
+		avr->cycles += 1;
+	}
+}
+
+// pointer registers X, Y and Z
+#define REG_X 26
+#define REG_Y 28
+#define REG_Z 30
+
+// ld and st with X, Y or Z, with post-increment (mode 1) or pre-decrement (mode 2)
+static void loadStore( avrCore_t* avr, uint8_t reg, uint8_t pointer, uint8_t mode, uint8_t store )
+{
+	uint16_t address = pair( avr, pointer );
+
+	if( mode == 2 )
+	{
+		address -= 1;
+	}
+
+	if( store )
+	{
+		*data( avr, address ) = avr->data[ reg ];
+	}
+	else
+	{
+		avr->data[ reg ] = *data( avr, address );
+	}
+
+	if( mode == 1 )
+	{
+		address += 1;
+	}
+
+	setPair( avr, pointer, address );
+	avr->cycles += 1;
+}
+
+
+/**
+ * @brief Execute a single instruction
+ */
+static void step( avrCore_t* avr )
+{
+	uint16_t const op = fetch( avr );
+	uint8_t const d = ( op >> 4 ) & 0x1f;                   // Rd of most instructions
+	uint8_t const r = ( op & 0x0f ) | ( ( op >> 5 ) & 0x10 ); // Rr of the two-register ones
+	uint8_t const dh = 16 + ( ( op >> 4 ) & 0x0f );         // Rd of the immediate ones
+	uint8_t const k = ( op & 0x0f ) | ( ( op >> 4 ) & 0xf0 ); // their immediate
+	uint8_t* const rd = &avr->data[ d ];
+	uint8_t const vr = avr->data[ r ];
+	uint8_t const c = flag( avr, SREG_C );
+
+	avr->cycles += 1;
+
+	switch( op >> 12 )
+	{
+		case 0x0:
+			switch( ( op >> 10 ) & 3 )
+			{
+				case 0:
+					if( op == 0 )
+					{
+						// nop
+					}
+					else if( ( op & 0xff00 ) == 0x0100 )
+					{
+						setPair( avr, ( op >> 3 ) & 0x1e, pair( avr, ( op << 1 ) & 0x1e ) );
+					}
+					else if( ( op & 0xff00 ) == 0x0200 )
+					{
+						// muls
+						multiply( avr, (int8_t) avr->data[ dh ] *
+						          (int8_t) avr->data[ 16 + ( op & 0x0f ) ], 0 );
+						avr->cycles += 1;
+					}
+					else
+					{
+						// mulsu, fmul, fmuls, fmulsu (r16 - r23)
+						uint8_t const a = avr->data[ 16 + ( ( op >> 4 ) & 7 ) ];
+						uint8_t const b = avr->data[ 16 + ( op & 7 ) ];
+						int32_t product;
+
+						switch( op & 0x88 )
+						{
+							case 0x00: product = (int8_t) a * b; break;
+							case 0x08: product = a * b; break;
+							case 0x80: product = (int8_t) a * (int8_t) b; break;
+							default:   product = (int8_t) a * b; break;
+						}
+
+						multiply( avr, product, ( op & 0x88 ) != 0 );
+						avr->cycles += 1;
+					}
+					break;
+
+				case 1: sub( avr, *rd, vr, c, 1 ); break;          // cpc
+				case 2: *rd = sub( avr, *rd, vr, c, 1 ); break;    // sbc
+				case 3: *rd = add( avr, *rd, vr, 0 ); break;       // add
+			}
+			break;
+
+		case 0x1:
+			switch( ( op >> 10 ) & 3 )
+			{
+				case 0:
+					// cpse
+					if( *rd == vr )
+					{
+						skip( avr );
+					}
+					break;
+
+				case 1: sub( avr, *rd, vr, 0, 0 ); break;          // cp
+				case 2: *rd = sub( avr, *rd, vr, 0, 0 ); break;    // sub
+				case 3: *rd = add( avr, *rd, vr, c ); break;       // adc
+			}
+			break;
+
+		case 0x2:
+			switch( ( op >> 10 ) & 3 )
+			{
+				case 0: *rd = logic( avr, *rd & vr ); break;
+				case 1: *rd = logic( avr, *rd ^ vr ); break;
+				case 2: *rd = logic( avr, *rd | vr ); break;
+				case 3: *rd = vr; break;
+			}
+			break;
+
+		case 0x3: sub( avr, avr->data[ dh ], k, 0, 0 ); break;                    // cpi
+		case 0x4: avr->data[ dh ] = sub( avr, avr->data[ dh ], k, c, 1 ); break; // sbci
+		case 0x5: avr->data[ dh ] = sub( avr, avr->data[ dh ], k, 0, 0 ); break; // subi
+		case 0x6: avr->data[ dh ] = logic( avr, avr->data[ dh ] | k ); break;    // ori
+		case 0x7: avr->data[ dh ] = logic( avr, avr->data[ dh ] & k ); break;    // andi
+
+		case 0x8:
+		case 0xa:
+		{
+			// ldd and std with Y or Z and a displacement (ld and st without one)
+			uint8_t const q = ( op & 7 ) | ( ( op >> 7 ) & 0x18 ) | ( ( op >> 8 ) & 0x20 );
+			uint16_t const address = pair( avr, op & 0x08 ? REG_Y : REG_Z ) + q;
+
+			if( op & 0x0200 )
+			{
+				*data( avr, address ) = *rd;
+			}
+			else
+			{
+				*rd = *data( avr, address );
+			}
+
+			avr->cycles += 1;
+			break;
+		}
+
+		case 0x9:
+			if( ( op & 0xfc00 ) == 0x9000 )
+			{
+				uint8_t const store = ( op & 0x0200 ) != 0;
+
+				switch( op & 0x0f )
+				{
+					case 0x0:
+					{
+						// lds, sts
+						uint16_t const address = fetch( avr );
+
+						if( store )
+						{
+							*data( avr, address ) = *rd;
+						}
+						else
+						{
+							*rd = *data( avr, address );
+						}
+
+						avr->cycles += 1;
+						break;
+					}
+
+					case 0x1: loadStore( avr, d, REG_Z, 1, store ); break;
+					case 0x2: loadStore( avr, d, REG_Z, 2, store ); break;
+					case 0x9: loadStore( avr, d, REG_Y, 1, store ); break;
+					case 0xa: loadStore( avr, d, REG_Y, 2, store ); break;
+					case 0xc: loadStore( avr, d, REG_X, 0, store ); break;
+					case 0xd: loadStore( avr, d, REG_X, 1, store ); break;
+					case 0xe: loadStore( avr, d, REG_X, 2, store ); break;
+
+					case 0x4:
+					case 0x5:
+						if( store )
+						{
+							fault( avr, "unknown instruction" );
+						}
+
+						// lpm Rd, Z(+)
+						if( pair( avr, REG_Z ) >= 2 * AVR_FLASH_WORDS )
+						{
+							fault( avr, "lpm out of range" );
+						}
+
+						*rd = avr->flash[ pair( avr, REG_Z ) / 2 ] >> ( pair( avr, REG_Z ) & 1 ) * 8;
+						if( op & 1 )
+						{
+							setPair( avr, REG_Z, pair( avr, REG_Z ) + 1 );
+						}
+						avr->cycles += 2;
+						break;
+
+					case 0xf:
+						if( store )
+						{
+							push( avr, *rd );
+						}
+						else
+						{
+							*rd = pop( avr );
+						}
+						avr->cycles += 1;
+						break;
+
+					default:
+						fault( avr, "unknown instruction" );
+				}
+			}
+			else if( ( op & 0xfe08 ) == 0x9400 )
+			{
+				// one-operand instructions
+				switch( op & 0x0f )
+				{
+					case 0x0:
+						*rd = ~*rd;
+						setFlags( avr, SREG_V | SREG_N | SREG_Z | SREG_C, nz( *rd ) | SREG_C );
+						break;
+
+					case 0x1: *rd = sub( avr, 0, *rd, 0, 0 ); break; // neg
+					case 0x2: *rd = ( *rd << 4 ) | ( *rd >> 4 ); break; // swap
+
+					case 0x3:
+						*rd += 1;
+						setFlags( avr, SREG_V | SREG_N | SREG_Z,
+						          nz( *rd ) | ( *rd == 0x80 ? SREG_V : 0 ) );
+						break;
+
+					case 0x5: *rd = shiftRight( avr, ( *rd >> 1 ) | ( *rd & 0x80 ), *rd & 1 ); break;
+					case 0x6: *rd = shiftRight( avr, *rd >> 1, *rd & 1 ); break;
+					case 0x7: *rd = shiftRight( avr, ( *rd >> 1 ) | ( c << 7 ), *rd & 1 ); break;
+
+					default:
+						fault( avr, "unknown instruction" );
+				}
+			}
+			else if( ( op & 0xfe0f ) == 0x940a )
+			{
+				// dec
+				*rd -= 1;
+				setFlags( avr, SREG_V | SREG_N | SREG_Z, nz( *rd ) | ( *rd == 0x7f ? SREG_V : 0 ) );
+			}
+			else if( ( op & 0xff0f ) == 0x9408 )
+			{
+				// bset, bclr
+				uint8_t const mask = 1 << ( ( op >> 4 ) & 7 );
+				avr->data[ AVR_SREG ] = op & 0x80 ? avr->data[ AVR_SREG ] & ~mask
+				                                  : avr->data[ AVR_SREG ] | mask;
+			}
+			else if( op == 0x9508 || op == 0x9518 )
+			{
+				// ret, reti
+				avr->pc = popPc( avr );
+				avr->cycles += 3;
+
+				if( op == 0x9518 )
+				{
+					avr->data[ AVR_SREG ] |= AVR_SREG_I;
+				}
+			}
+			else if( op == 0x9409 || op == 0x9509 )
+			{
+				// ijmp, icall
+				if( op == 0x9509 )
+				{
+					pushPc( avr, avr->pc );
+					avr->cycles += 1;
+				}
+
+				avr->pc = pair( avr, REG_Z );
+				avr->cycles += 1;
+			}
+			else if( ( op & 0xfe0c ) == 0x940c )
+			{
+				// jmp, call
+				uint32_t const target = ( ( op >> 3 ) & 0x3e ) << 16 | ( op & 1 ) << 16 | fetch( avr );
+
+				if( op & 0x0002 )
+				{
+					pushPc( avr, avr->pc );
+					avr->cycles += 1;
+				}
+
+				avr->pc = target;
+				avr->cycles += 2;
+			}
+			else if( op == 0x95c8 )
+			{
+				// lpm (r0, Z)
+				if( pair( avr, REG_Z ) >= 2 * AVR_FLASH_WORDS )
+				{
+					fault( avr, "lpm out of range" );
+				}
+
+				avr->data[ 0 ] = avr->flash[ pair( avr, REG_Z ) / 2 ] >> ( pair( avr, REG_Z ) & 1 ) * 8;
+				avr->cycles += 2;
+			}
+			else if( op == 0x95a8 )
+			{
+				// wdr
+			}
+			else if( ( op & 0xfe00 ) == 0x9600 )
+			{
+				// adiw, sbiw
+				uint8_t const reg = 24 + ( ( op >> 3 ) & 6 );
+				uint16_t const value = pair( avr, reg );
+				uint16_t const constant = ( op & 0x0f ) | ( ( op >> 2 ) & 0x30 );
+				uint16_t const result = op & 0x0100 ? value - constant : value + constant;
+				uint16_t const overflow = op & 0x0100 ? value & ~result : ~value & result;
+				uint16_t const carry = op & 0x0100 ? result & ~value : ~result & value;
+
+				setPair( avr, reg, result );
+				setFlags( avr, SREG_V | SREG_N | SREG_Z | SREG_C,
+				          ( overflow & 0x8000 ? SREG_V : 0 ) | ( carry & 0x8000 ? SREG_C : 0 ) |
+				          ( result & 0x8000 ? SREG_N : 0 ) | ( result == 0 ? SREG_Z : 0 ) );
+				avr->cycles += 1;
+			}
+			else if( ( op & 0xfc00 ) == 0x9800 )
+			{
+				// cbi, sbic, sbi, sbis
+				uint8_t* const io = &avr->data[ 0x20 + ( ( op >> 3 ) & 0x1f ) ];
+				uint8_t const mask = 1 << ( op & 7 );
+
+				switch( ( op >> 8 ) & 3 )
+				{
+					case 0: *io &= ~mask; avr->cycles += 1; break;
+					case 1: if( !( *io & mask ) ) { skip( avr ); } break;
+					case 2: *io |= mask; avr->cycles += 1; break;
+					case 3: if( *io & mask ) { skip( avr ); } break;
+				}
+			}
+			else if( ( op & 0xfc00 ) == 0x9c00 )
+			{
+				// mul
+				multiply( avr, *rd * vr, 0 );
+				avr->cycles += 1;
+			}
+			else
+			{
+				fault( avr, op == 0x9588 ? "sleep" : "unknown instruction" );
+			}
+			break;
+
+		case 0xb:
+		{
+			// in, out
+			uint8_t* const io = &avr->data[ 0x20 + ( ( op & 0x0f ) | ( ( op >> 5 ) & 0x30 ) ) ];
+
+			if( op & 0x0800 )
+			{
+				*io = *rd;
+			}
+			else
+			{
+				*rd = *io;
+			}
+			break;
+		}
+
+		case 0xc:
+		case 0xd:
+			// rjmp, rcall
+			if( op & 0x1000 )
+			{
+				pushPc( avr, avr->pc );
+				avr->cycles += 1;
+			}
+
+			avr->pc = ( avr->pc + ( (int16_t) ( op << 4 ) >> 4 ) ) & ( AVR_FLASH_WORDS - 1 );
+			avr->cycles += 1;
+			break;
+
+		case 0xe: avr->data[ dh ] = k; break; // ldi
+
+		case 0xf:
+			if( !( op & 0x0800 ) )
+			{
+				// brbs, brbc
+				if( flag( avr, 1 << ( op & 7 ) ) == !( op & 0x0400 ) )
+				{
+					avr->pc += (int8_t) ( ( op >> 2 ) & 0xfe ) >> 1;
+					avr->cycles += 1;
+				}
+			}
+			else if( !( op & 0x0008 ) )
+			{
+				uint8_t const mask = 1 << ( op & 7 );
+
+				switch( ( op >> 9 ) & 3 )
+				{
+					case 0: *rd = flag( avr, SREG_T ) ? *rd | mask : *rd & ~mask; break; // bld
+					case 1: setFlags( avr, SREG_T, *rd & mask ? SREG_T : 0 ); break;    // bst
+					case 2: if( !( *rd & mask ) ) { skip( avr ); } break;                // sbrc
+					case 3: if( *rd & mask ) { skip( avr ); } break;                     // sbrs
+				}
+			}
+			else
+			{
+				fault( avr, "unknown instruction" );
+			}
+			break;
+	}
+}
+
+
+// calls -------------------------------------------------------------------------------------------
+
+// run until the pseudo return address has been reached
+static void run( avrCore_t* avr )
+{
+	uint64_t const end = avr->cycles + MAX_CALL_CYCLES;
+
+	while( avr->pc != RETURN_ADDRESS )
+	{
+		if( avr->cycles > end )
+		{
+			fault( avr, "no return" );
+		}
+
+		step( avr );
+	}
+}
+
+
+/**
+ * @brief Call a function (at a byte address in the flash) with a single 8 or 16 bit argument
+ *
+ * Returns the function's return value (r25:r24). The caller has to clear r1 (as avr-gcc expects).
+ */
+uint16_t avrCall( avrCore_t* avr, uint32_t address, uint16_t arg )
+{
+	setPair( avr, 24, arg );
+	pushPc( avr, RETURN_ADDRESS );
+	avr->pc = address / 2;
+
+	run( avr );
+
+	return pair( avr, 24 );
+}
+
+
+/**
+ * @brief Execute an interrupt handler (at a byte address in the flash)
+ *
+ * Returns its cycles, including the interrupt response (4) and the rjmp in the vector table (2).
+ * The handler has to return with reti.
+ */
+uint32_t avrInterrupt( avrCore_t* avr, uint32_t address )
+{
+	uint64_t const start = avr->cycles;
+
+	if( !flag( avr, AVR_SREG_I ) )
+	{
+		fault( avr, "interrupt with interrupts disabled" );
+	}
+
+	pushPc( avr, RETURN_ADDRESS );
+	avr->data[ AVR_SREG ] &= ~AVR_SREG_I;
+	avr->pc = address / 2;
+	avr->cycles += 4 + 2;
+
+	run( avr );
+
+	if( !flag( avr, AVR_SREG_I ) )
+	{
+		fault( avr, "interrupt handler returned without reti" );
+	}
+
+	return avr->cycles - start;
+}
@@ -0,0 +1,41 @@
+#ifndef AVRCORE_H_
+#define AVRCORE_H_
+
+// Instruction set interpreter of the ATmega8 core, for running firmware functions and interrupt
+// handlers on the PC with exact cycle counts (see avrcore.c). There are no peripherals: the I/O
+// registers are plain memory, which the host program inspects and changes.
+
+#include <inttypes.h>
+
+
+#define AVR_FLASH_WORDS 4096
+#define AVR_DATA_SIZE 0x460   // 32 registers, 64 I/O registers, 1 KB SRAM
+
+// data addresses of some I/O registers
+#define AVR_SREG 0x5f
+#define AVR_SPH 0x5e
+#define AVR_SPL 0x5d
+
+// I flag of the SREG
+#define AVR_SREG_I 0x80
+
+typedef struct
+{
+	uint16_t flash[ AVR_FLASH_WORDS ];
+	uint8_t data[ AVR_DATA_SIZE ];   // registers, I/O registers (from 0x20) and SRAM (from 0x60)
+	uint32_t pc;                     // in words
+	uint64_t cycles;
+
+	// the ELF file (for avrSymbol())
+	uint8_t* elf;
+	long elfSize;
+}
+avrCore_t;
+
+int avrLoad( avrCore_t* avr, char const* path );
+int avrSymbol( avrCore_t const* avr, char const* name, uint32_t* address );
+uint16_t avrCall( avrCore_t* avr, uint32_t address, uint16_t arg );
+uint32_t avrInterrupt( avrCore_t* avr, uint32_t address );
+
+
+#endif // AVRCORE_H_
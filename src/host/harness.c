@@ -0,0 +1,433 @@
+/**
+ * Host (PC) harness for the animations
+ *
+ * This runs the animation programs from animations.c on the PC instead of the ATmega8, so they can
+ * be profiled and regression-tested without flashing a chip. The frame API from ledterne.h is
+ * replaced by a stub that records every committed frame.
+ *
+ * For each program, the harness
+ *
+ * - executes the given number of frames and reports the achieved frame rate,
+ * - writes the first frames as raw binary stream (NUM_PIXELS * 3 bytes per frame, the LED
+ *   intensities as passed to setPixel()) and as PPM image strip (one row per frame),
+ * - computes a checksum over all frames,
+ *
+ * and compares the stream and the checksum to the golden output in the golden directory (if
+ * given). Any divergence makes the harness fail.
+ *
+ * The scripted versions of the programs (see script.h) and their pre-rendered streams (see
+ * StreamProgram in animations.h) are compared to the golden output of the native ones, they have
+ * to draw exactly the same frames.
+ */
+
+#include "animations.h"
+#include "ledterne.h"
+#include "script.h"
+#include "streams.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+
+#define FRAME_SIZE ( 3 * NUM_PIXELS )
+
+// default number of frames to execute per program
+#define DEFAULT_NUM_FRAMES 1000000UL
+
+// number of frames to write to the binary stream and PPM strip
+#define NUM_DUMP_FRAMES 1024
+
+
+typedef struct
+{
+	char const* name;
+	char const* golden;                        // name of the golden output
+	uint8_t const* data;                       // script or stream, NULL for native programs
+	void (*init)( void* );                     // for native programs
+	void (*initData)( void*, uint8_t const* ); // for scripts and streams
+	uint8_t (*execute)( void* );
+}
+program_t;
+
+#define PROGRAM( name )                         \
+	{                                           \
+		#name,                                  \
+		#name,                                  \
+		NULL,                                   \
+		(void (*)( void* )) &name##_init,       \
+		NULL,                                   \
+		(uint8_t (*)( void* )) &name##_execute, \
+	}
+
+#define SCRIPT( name )                                        \
+	{                                                         \
+		"Script" #name,                                       \
+		#name,                                                \
+		g_script##name,                                       \
+		NULL,                                                 \
+		(void (*)( void*, uint8_t const* )) &Script_init,     \
+		(uint8_t (*)( void* )) &Script_execute,               \
+	}
+
+#define STREAM( name )                                        \
+	{                                                         \
+		"Stream" #name,                                       \
+		#name,                                                \
+		g_stream##name,                                       \
+		NULL,                                                 \
+		(void (*)( void*, uint8_t const* )) &Stream_init,     \
+		(uint8_t (*)( void* )) &Stream_execute,               \
+	}
+
+static program_t const g_programs[] =
+{
+	PROGRAM( MixedColorBlending ),
+	PROGRAM( KnightRider ),
+	PROGRAM( ColoredConveyor ),
+	PROGRAM( TestDisplays ),
+	PROGRAM( Rainbow ),
+	PROGRAM( CandleFlicker ),
+	SCRIPT( MixedColorBlending ),
+	SCRIPT( KnightRider ),
+	SCRIPT( ColoredConveyor ),
+	SCRIPT( TestDisplays ),
+	// the colors of MixedColorBlending only repeat after 2728 runs, which is too long for a stream
+	STREAM( KnightRider ),
+	STREAM( ColoredConveyor ),
+	STREAM( TestDisplays ),
+};
+
+#define NUM_PROGRAMS ( sizeof( g_programs ) / sizeof( g_programs[ 0 ] ) )
+
+
+// frame API stub ----------------------------------------------------------------------------------
+
+static uint8_t g_frame[ FRAME_SIZE ];
+
+// recorded frames (the first NUM_DUMP_FRAMES of the current program)
+static uint8_t g_dump[ NUM_DUMP_FRAMES ][ FRAME_SIZE ];
+
+static unsigned long g_numFrames;
+static uint64_t g_hash;
+
+// time between two frames for the programs that use animationTime() (ms)
+#define FRAME_PERIOD 20
+
+uint16_t animationTime( void )
+{
+	return g_numFrames * FRAME_PERIOD;
+}
+
+void beginFrame( void )
+{
+}
+
+void setPixel( uint8_t pixelIndex, uint8_t r, uint8_t g, uint8_t b )
+{
+	if( pixelIndex >= NUM_PIXELS )
+	{
+		return;
+	}
+
+	g_frame[ 3 * pixelIndex + 0 ] = r <= MAX_INTENSITY ? r : MAX_INTENSITY;
+	g_frame[ 3 * pixelIndex + 1 ] = g <= MAX_INTENSITY ? g : MAX_INTENSITY;
+	g_frame[ 3 * pixelIndex + 2 ] = b <= MAX_INTENSITY ? b : MAX_INTENSITY;
+}
+
+// the recorded frames (and the golden output) hold whole intensities
+void setPixelFine( uint8_t pixelIndex, uint8_t r, uint8_t g, uint8_t b )
+{
+	setPixel( pixelIndex, r >> INTENSITY_FRACTION_BITS, g >> INTENSITY_FRACTION_BITS,
+	          b >> INTENSITY_FRACTION_BITS );
+}
+
+void commitFrame( void )
+{
+	uint8_t i;
+
+	if( g_numFrames < NUM_DUMP_FRAMES )
+	{
+		memcpy( g_dump[ g_numFrames ], g_frame, FRAME_SIZE );
+	}
+
+	// FNV-1a
+	for( i = 0; i < FRAME_SIZE; i++ )
+	{
+		g_hash = ( g_hash ^ g_frame[ i ] ) * 0x100000001b3ULL;
+	}
+
+	g_numFrames += 1;
+}
+
+
+// harness -----------------------------------------------------------------------------------------
+
+static double now( void )
+{
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
+static int writeFile( char const* dir, char const* name, char const* ext,
+                      void const* header, size_t headerSize, void const* data, size_t size )
+{
+	char path[ 1024 ];
+	snprintf( path, sizeof( path ), "%s/%s.%s", dir, name, ext );
+
+	FILE* f = fopen( path, "wb" );
+	if( !f )
+	{
+		fprintf( stderr, "cannot write %s: %s\n", path, strerror( errno ) );
+		return 0;
+	}
+
+	fwrite( header, 1, headerSize, f );
+	fwrite( data, 1, size, f );
+	fclose( f );
+
+	return 1;
+}
+
+
+static int writeOutput( char const* dir, char const* name, unsigned long numDumped )
+{
+	static uint8_t ppm[ NUM_DUMP_FRAMES ][ FRAME_SIZE ];
+	char header[ 64 ];
+	unsigned long i, j;
+
+	// scale intensities to the full 8 bit range of the PPM image
+	for( i = 0; i < numDumped; i++ )
+	{
+		for( j = 0; j < FRAME_SIZE; j++ )
+		{
+			ppm[ i ][ j ] = g_dump[ i ][ j ] * 255 / MAX_INTENSITY;
+		}
+	}
+
+	int headerSize = snprintf( header, sizeof( header ), "P6\n%d %lu\n255\n", NUM_PIXELS, numDumped );
+
+	return writeFile( dir, name, "bin", NULL, 0, g_dump, numDumped * FRAME_SIZE )
+	    && writeFile( dir, name, "ppm", header, headerSize, ppm, numDumped * FRAME_SIZE );
+}
+
+
+static int writeGolden( char const* dir, char const* name, unsigned long numDumped )
+{
+	char summary[ 64 ];
+	int summarySize = snprintf( summary, sizeof( summary ), "%lu %016" PRIx64 "\n",
+	                            g_numFrames, g_hash );
+
+	return writeFile( dir, name, "bin", NULL, 0, g_dump, numDumped * FRAME_SIZE )
+	    && writeFile( dir, name, "hash", summary, summarySize, NULL, 0 );
+}
+
+
+static int compareGolden( char const* dir, char const* name, unsigned long numDumped )
+{
+	static uint8_t golden[ NUM_DUMP_FRAMES ][ FRAME_SIZE ];
+	char path[ 1024 ];
+	unsigned long i, j;
+
+	snprintf( path, sizeof( path ), "%s/%s.bin", dir, name );
+	FILE* f = fopen( path, "rb" );
+	if( !f )
+	{
+		fprintf( stderr, "%s: cannot read %s: %s\n", name, path, strerror( errno ) );
+		return 0;
+	}
+
+	size_t numGolden = fread( golden, FRAME_SIZE, NUM_DUMP_FRAMES, f );
+	fclose( f );
+
+	for( i = 0; i < numDumped && i < numGolden; i++ )
+	{
+		for( j = 0; j < FRAME_SIZE; j++ )
+		{
+			if( g_dump[ i ][ j ] != golden[ i ][ j ] )
+			{
+				fprintf( stderr, "%s: frame %lu, pixel %lu, channel %c: %u (expected %u)\n",
+				         name, i, j / 3, "rgb"[ j % 3 ], g_dump[ i ][ j ], golden[ i ][ j ] );
+				return 0;
+			}
+		}
+	}
+
+	if( numGolden != numDumped )
+	{
+		fprintf( stderr, "%s: %lu frames (expected %zu)\n", name, numDumped, numGolden );
+		return 0;
+	}
+
+	unsigned long goldenFrames;
+	uint64_t goldenHash;
+
+	snprintf( path, sizeof( path ), "%s/%s.hash", dir, name );
+	f = fopen( path, "r" );
+	if( !f || fscanf( f, "%lu %" SCNx64, &goldenFrames, &goldenHash ) != 2 )
+	{
+		fprintf( stderr, "%s: cannot read %s\n", name, path );
+		if( f )
+		{
+			fclose( f );
+		}
+		return 0;
+	}
+	fclose( f );
+
+	// the checksum can only be compared if the same number of frames has been executed
+	if( goldenFrames == g_numFrames && goldenHash != g_hash )
+	{
+		fprintf( stderr, "%s: checksum over %lu frames differs\n", name, g_numFrames );
+		return 0;
+	}
+
+	return 1;
+}
+
+
+static void usage( char const* argv0 )
+{
+	fprintf( stderr,
+		"usage: %s [-n frames] [-o outdir] [-c goldendir | -w goldendir] [program...]\n"
+		"\n"
+		"  -n frames     number of frames to execute per program (default %lu)\n"
+		"  -o outdir     write frame streams (.bin) and PPM strips (.ppm) to outdir\n"
+		"  -c goldendir  compare output to golden output, fail on divergence\n"
+		"  -w goldendir  write golden output\n"
+		"\n"
+		"programs:",
+		argv0, DEFAULT_NUM_FRAMES );
+
+	unsigned int i;
+	for( i = 0; i < NUM_PROGRAMS; i++ )
+	{
+		fprintf( stderr, " %s", g_programs[ i ].name );
+	}
+	fprintf( stderr, "\n" );
+
+	exit( 2 );
+}
+
+
+int main( int argc, char** argv )
+{
+	unsigned long numFrames = DEFAULT_NUM_FRAMES;
+	char const* outDir = NULL;
+	char const* goldenDir = NULL;
+	int writeGoldenOutput = 0;
+	int failed = 0;
+	int opt;
+
+	while( ( opt = getopt( argc, argv, "n:o:c:w:h" ) ) != -1 )
+	{
+		switch( opt )
+		{
+			case 'n':
+				numFrames = strtoul( optarg, NULL, 0 );
+				break;
+			case 'o':
+				outDir = optarg;
+				break;
+			case 'c':
+				goldenDir = optarg;
+				writeGoldenOutput = 0;
+				break;
+			case 'w':
+				goldenDir = optarg;
+				writeGoldenOutput = 1;
+				break;
+			default:
+				usage( argv[ 0 ] );
+		}
+	}
+
+	unsigned int i;
+
+	for( i = 0; i < NUM_PROGRAMS; i++ )
+	{
+		program_t const* program = &g_programs[ i ];
+
+		// run all programs or only the ones given on the command line
+		if( optind < argc )
+		{
+			int selected = 0;
+			int a;
+
+			for( a = optind; a < argc; a++ )
+			{
+				selected |= strcmp( argv[ a ], program->name ) == 0;
+			}
+
+			if( !selected )
+			{
+				continue;
+			}
+		}
+
+		memset( g_frame, 0, sizeof( g_frame ) );
+		g_numFrames = 0;
+		g_hash = 0xcbf29ce484222325ULL;
+
+		unsigned long programsFinished = 0;
+		unsigned long n;
+
+		static AnimationProgramStorage prog;
+
+		if( program->data )
+		{
+			program->initData( &prog, program->data );
+		}
+		else
+		{
+			program->init( &prog );
+		}
+
+		double start = now();
+
+		for( n = 0; n < numFrames; n++ )
+		{
+			beginFrame();
+			programsFinished += program->execute( &prog );
+			commitFrame();
+		}
+
+		double elapsed = now() - start;
+
+		unsigned long numDumped = g_numFrames < NUM_DUMP_FRAMES ? g_numFrames : NUM_DUMP_FRAMES;
+
+		printf( "%-26s %10lu frames %8lu runs %10.3f s %12.0f frames/s  hash %016" PRIx64 "\n",
+		        program->name, g_numFrames, programsFinished, elapsed,
+		        elapsed > 0 ? g_numFrames / elapsed : 0.0, g_hash );
+
+		if( outDir && !writeOutput( outDir, program->name, numDumped ) )
+		{
+			failed = 1;
+		}
+
+		if( goldenDir )
+		{
+			if( writeGoldenOutput )
+			{
+				// the golden output is defined by the native programs
+				if( !program->data )
+				{
+					failed |= !writeGolden( goldenDir, program->golden, numDumped );
+				}
+			}
+			else if( !compareGolden( goldenDir, program->golden, numDumped ) )
+			{
+				fprintf( stderr, "%s: output differs from golden output\n", program->name );
+				failed = 1;
+			}
+		}
+	}
+
+	return failed;
+}
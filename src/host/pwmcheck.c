@@ -0,0 +1,533 @@
+/**
+ * Host (PC) check of the PWM engines
+ *
+ * This runs the interrupt handlers of pwm.c on the PC against a simulated timer and output ports
+ * (see the stand-ins in avr/) and checks that each LED is lit for exactly its duty cycle. The
+ * Makefile builds it once for each combination of PWM_ENGINE, PWM_OUTPUT, PWM_STAGGER and
+ * PWM_DITHER_BITS (see pwm.h).
+ *
+ * The timer is simulated tick by tick: a tick is a PWM step for PWM_ENGINE_STEP (one interrupt
+ * each) and a timer tick for the others (the interrupts fire as programmed through OCR2, TCNT2 and
+ * TIMSK). After each tick, the outputs are sampled: the pins of the ATmega8, or the latched
+ * contents of the simulated 74HC595 chain, which is loaded by the SPI bursts of the interrupt
+ * handler and latched at its end. While the interrupt handlers have stopped the timer, the outputs
+ * are sampled in PWM cycles of the same length.
+ *
+ * The check runs a series of random frames and calls pwmUpdate() at random points in time. From the
+ * first PWM cycle that begins after an update, each channel has to be lit for
+ *
+ * - exactly its duty cycle in whole steps, summed over 2^PWM_DITHER_BITS successive PWM cycles
+ *   (the duty cycle with its fractional bits),
+ * - all or none of the PWM cycle if the frame is constant (all LEDs either off or at maximum
+ *   brightness, the timer is stopped then),
+ *
+ * and the PWM cycles have to be of the engine's length. Pins that do not drive LEDs have to keep
+ * their values. Any divergence makes the check fail.
+ */
+
+#include "pwm.h"
+
+#include <avr/interrupt.h>
+#include <avr/io.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+#define NUM_CHANNELS ( 3 * NUM_PIXELS )
+
+// PWM cycles over which the dithered duty cycles add up to the exact ones
+#define DITHER_CYCLES ( 1 << PWM_DITHER_BITS )
+
+// timer ticks per PWM cycle
+#if PWM_ENGINE == PWM_ENGINE_BAM
+#define CYCLE_TICKS 255
+#else
+#define CYCLE_TICKS 256
+#endif
+
+#define NUM_FRAMES 200
+
+// PWM cycles to run each frame for (plus up to one more, so the updates come at random steps)
+#define FRAME_CYCLES ( 2 * DITHER_CYCLES + 2 )
+
+// clock select bits of timer 2 (0: stopped)
+#define TIMER_CLOCK ( (1<<CS22) | (1<<CS21) | (1<<CS20) )
+
+
+// simulated I/O registers -------------------------------------------------------------------------
+
+volatile uint8_t PORTB, DDRB;
+volatile uint8_t PORTC, DDRC;
+volatile uint8_t PORTD, DDRD;
+volatile uint8_t TCCR2, TCNT2, OCR2;
+volatile uint8_t TIMSK, TIFR;
+volatile uint8_t SPCR;
+
+// bytes written to SPDR since the last tick
+static uint8_t g_spiBurst[ 64 ];
+static uint8_t g_spiLength;
+
+volatile uint8_t* hostSpiData( void )
+{
+	if( g_spiLength == sizeof( g_spiBurst ) )
+	{
+		fprintf( stderr, "SPI burst too long\n" );
+		exit( 1 );
+	}
+
+	return &g_spiBurst[ g_spiLength++ ];
+}
+
+volatile uint8_t* hostSpiStatus( void )
+{
+	static volatile uint8_t status;
+
+	status |= (1<<SPIF);
+	return &status;
+}
+
+void TIMER2_COMP_vect( void );
+#if PWM_ENGINE == PWM_ENGINE_EVENT
+void TIMER2_OVF_vect( void );
+#endif
+
+
+// outputs -----------------------------------------------------------------------------------------
+
+#if PWM_OUTPUT == PWM_OUTPUT_PINS
+
+// wiring of the LEDs (see g_channels in pwm.c)
+static struct
+{
+	volatile uint8_t* port;
+	uint8_t bit;
+}
+const g_pins[ NUM_CHANNELS ] =
+{
+	{ &PORTB, PB2 }, { &PORTB, PB1 }, { &PORTB, PB0 },
+	{ &PORTD, PD7 }, { &PORTD, PD6 }, { &PORTD, PD5 },
+	{ &PORTD, PD2 }, { &PORTD, PD1 }, { &PORTD, PD0 },
+	{ &PORTC, PC2 }, { &PORTC, PC1 }, { &PORTC, PC0 },
+	{ &PORTB, PB5 }, { &PORTB, PB4 }, { &PORTB, PB3 },
+};
+
+// values of the other pins before pwmInit()
+#define IDLE_PORTB 0xc0
+#define IDLE_PORTC 0x38
+#define IDLE_PORTD 0x18
+
+static void initOutputs( void )
+{
+	PORTB = IDLE_PORTB;
+	PORTC = IDLE_PORTC;
+	PORTD = IDLE_PORTD;
+}
+
+static void sampleOutputs( uint8_t* lit )
+{
+	uint8_t ledB = 0;
+	uint8_t ledC = 0;
+	uint8_t ledD = 0;
+	uint8_t i;
+
+	for( i = 0; i < NUM_CHANNELS; i++ )
+	{
+		uint8_t const mask = 1 << g_pins[ i ].bit;
+
+		lit[ i ] = ( *g_pins[ i ].port & mask ) != 0;
+
+		ledB |= g_pins[ i ].port == &PORTB ? mask : 0;
+		ledC |= g_pins[ i ].port == &PORTC ? mask : 0;
+		ledD |= g_pins[ i ].port == &PORTD ? mask : 0;
+	}
+
+	if( ( DDRB & ledB ) != ledB || ( DDRC & ledC ) != ledC || ( DDRD & ledD ) != ledD ||
+	    ( PORTB & ~ledB ) != IDLE_PORTB || ( PORTC & ~ledC ) != IDLE_PORTC ||
+	    ( PORTD & ~ledD ) != IDLE_PORTD )
+	{
+		fprintf( stderr, "LED pins not configured as outputs or other pins changed\n" );
+		exit( 1 );
+	}
+}
+
+#else
+
+// shift registers of the chain (the first one receives the SPI) and their latched outputs
+#define NUM_REGISTERS ( ( NUM_CHANNELS + 7 ) / 8 )
+static uint8_t g_shiftRegisters[ NUM_REGISTERS ];
+static uint8_t g_latched[ NUM_REGISTERS ];
+
+static void initOutputs( void )
+{
+}
+
+static void sampleOutputs( uint8_t* lit )
+{
+	uint8_t i;
+
+	if( g_spiLength > 0 )
+	{
+		// the interrupt handlers always load the whole chain
+		if( g_spiLength != NUM_REGISTERS || !( SPCR & (1<<SPE) ) )
+		{
+			fprintf( stderr, "SPI burst of %u bytes for %u shift registers\n", g_spiLength,
+			         NUM_REGISTERS );
+			exit( 1 );
+		}
+
+		if( PORTB & (1<<PB2) )
+		{
+			fprintf( stderr, "STCP (PB2) left high after the burst\n" );
+			exit( 1 );
+		}
+
+		for( i = 0; i < g_spiLength; i++ )
+		{
+			memmove( g_shiftRegisters + 1, g_shiftRegisters, NUM_REGISTERS - 1 );
+			g_shiftRegisters[ 0 ] = g_spiBurst[ i ];
+		}
+
+		memcpy( g_latched, g_shiftRegisters, NUM_REGISTERS );
+		g_spiLength = 0;
+	}
+
+	for( i = 0; i < NUM_CHANNELS; i++ )
+	{
+		lit[ i ] = ( g_latched[ i / 8 ] >> ( i % 8 ) ) & 1;
+	}
+}
+
+#endif
+
+
+// timer -------------------------------------------------------------------------------------------
+
+/**
+ * @brief Advance the running timer by a single tick and fire its interrupts
+ *
+ * Returns whether a PWM cycle begins with this tick.
+ */
+#if PWM_ENGINE == PWM_ENGINE_STEP
+
+static uint8_t timerTick( void )
+{
+	// PWM step of the interrupt handler (it starts over after stopping the timer)
+	static uint8_t step = 0;
+	uint8_t const begin = step == 0;
+
+	if( TIMSK & (1<<OCIE2) )
+	{
+		TIMER2_COMP_vect();
+	}
+
+	step = TCCR2 & TIMER_CLOCK ? step + 1 : 0;
+	return begin;
+}
+
+#elif PWM_ENGINE == PWM_ENGINE_BAM
+
+static uint8_t timerTick( void )
+{
+	// bit period of the interrupt handler (it starts over after stopping the timer)
+	static uint8_t bit = 0;
+	uint8_t begin;
+
+	// Clear Timer on Compare
+	if( TCNT2 != OCR2 )
+	{
+		TCNT2 += 1;
+		return 0;
+	}
+
+	TCNT2 = 0;
+	begin = bit == 0;
+
+	if( TIMSK & (1<<OCIE2) )
+	{
+		TIMER2_COMP_vect();
+	}
+
+	bit = TCCR2 & TIMER_CLOCK ? ( bit + 1 ) & 7 : 0;
+	return begin;
+}
+
+#elif PWM_ENGINE == PWM_ENGINE_EVENT
+
+static uint8_t timerTick( void )
+{
+	TCNT2 += 1;
+
+	if( TCNT2 == 0 )
+	{
+		if( TIMSK & (1<<TOIE2) )
+		{
+			TIMER2_OVF_vect();
+		}
+
+		return 1;
+	}
+
+	if( ( TIMSK & (1<<OCIE2) ) && TCNT2 == OCR2 )
+	{
+		TIMER2_COMP_vect();
+	}
+
+	return 0;
+}
+
+#endif
+
+
+// check -------------------------------------------------------------------------------------------
+
+static pwmDuty_t g_frames[ NUM_FRAMES ][ NUM_CHANNELS ];
+
+// PWM cycle being sampled
+static struct
+{
+	int frame;                          // frame displayed in the cycle (-1: none)
+	unsigned ticks;
+	uint8_t stopped;                    // the timer has been stopped during the cycle
+	unsigned long lit[ NUM_CHANNELS ];  // ticks each channel was lit for
+}
+g_cycle;
+
+// on-times of the channels summed over the PWM cycles of the current dither period
+static unsigned long g_ditherLit[ NUM_CHANNELS ];
+static unsigned g_ditherCycles;
+
+static unsigned long g_checkedCycles;
+static unsigned g_checkedPerFrame[ NUM_FRAMES ];
+
+
+static uint32_t random32( void )
+{
+	// xorshift32 (the same sequence on every host)
+	static uint32_t state = 0x2545f491;
+
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+	return state;
+}
+
+
+static void fail( int frame, uint8_t channel, unsigned long lit, unsigned long expected )
+{
+	fprintf( stderr, "frame %d, channel %u (duty %lu): lit for %lu ticks instead of %lu\n",
+	         frame, channel, (unsigned long) g_frames[ frame ][ channel ], lit, expected );
+	exit( 1 );
+}
+
+
+// whether all LEDs of a frame are either off or at maximum brightness
+static uint8_t isConstant( int frame )
+{
+	uint8_t i;
+
+	for( i = 0; i < NUM_CHANNELS; i++ )
+	{
+		if( g_frames[ frame ][ i ] != 0 && g_frames[ frame ][ i ] < PWM_MAX_DUTY )
+		{
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+
+/**
+ * @brief Check the on-times of the PWM cycle that has just ended
+ */
+static void checkCycle( void )
+{
+	int const frame = g_cycle.frame;
+	uint8_t i;
+
+	if( frame < 0 )
+	{
+		return;
+	}
+
+	if( isConstant( frame ) )
+	{
+		// cut short by the restart of the timer
+		if( g_cycle.ticks != CYCLE_TICKS )
+		{
+			return;
+		}
+
+		for( i = 0; i < NUM_CHANNELS; i++ )
+		{
+			unsigned long const expected = g_frames[ frame ][ i ] ? CYCLE_TICKS : 0;
+
+			if( g_cycle.lit[ i ] != expected )
+			{
+				fail( frame, i, g_cycle.lit[ i ], expected );
+			}
+		}
+
+		g_checkedCycles += 1;
+	}
+	else
+	{
+		if( g_cycle.ticks != CYCLE_TICKS || g_cycle.stopped )
+		{
+			fprintf( stderr, "frame %d: PWM cycle of %u ticks%s\n", frame, g_cycle.ticks,
+			         g_cycle.stopped ? ", timer stopped" : "" );
+			exit( 1 );
+		}
+
+		for( i = 0; i < NUM_CHANNELS; i++ )
+		{
+			g_ditherLit[ i ] += g_cycle.lit[ i ];
+		}
+
+		if( ++g_ditherCycles < DITHER_CYCLES )
+		{
+			return;
+		}
+
+		for( i = 0; i < NUM_CHANNELS; i++ )
+		{
+			pwmDuty_t const duty = g_frames[ frame ][ i ];
+			unsigned long const expected = duty <= PWM_MAX_DUTY ? duty : PWM_MAX_DUTY;
+
+			if( g_ditherLit[ i ] != expected )
+			{
+				fail( frame, i, g_ditherLit[ i ], expected );
+			}
+		}
+
+		memset( g_ditherLit, 0, sizeof( g_ditherLit ) );
+		g_ditherCycles = 0;
+		g_checkedCycles += DITHER_CYCLES;
+	}
+
+	g_checkedPerFrame[ frame ] += 1;
+}
+
+
+static void beginCycle( int frame )
+{
+	if( frame != g_cycle.frame )
+	{
+		memset( g_ditherLit, 0, sizeof( g_ditherLit ) );
+		g_ditherCycles = 0;
+	}
+
+	memset( &g_cycle, 0, sizeof( g_cycle ) );
+	g_cycle.frame = frame;
+}
+
+
+/**
+ * @brief Generate random duty cycles
+ *
+ * They include LEDs that are off, at maximum brightness or beyond and LEDs with the same duty
+ * cycle as the previous one (which share events). Every fifth frame is constant.
+ */
+static void randomFrame( int frame )
+{
+	pwmDuty_t* duty = g_frames[ frame ];
+	uint8_t i;
+
+	for( i = 0; i < NUM_CHANNELS; i++ )
+	{
+		uint32_t const r = random32();
+
+		if( frame % 5 == 4 )
+		{
+			duty[ i ] = r % 2 ? PWM_MAX_DUTY : 0;
+			continue;
+		}
+
+		switch( r % 8 )
+		{
+			case 0:  duty[ i ] = 0; break;
+			case 1:  duty[ i ] = PWM_MAX_DUTY; break;
+			case 2:  duty[ i ] = (pwmDuty_t) ~0; break;
+			case 3:  duty[ i ] = i > 0 ? duty[ i - 1 ] : 1; break;
+			default: duty[ i ] = 1 + ( r >> 8 ) % ( PWM_MAX_DUTY - 1 ); break;
+		}
+	}
+
+	// at least one dimmed LED, so the frame is not constant after all
+	if( frame % 5 != 4 && isConstant( frame ) )
+	{
+		duty[ 0 ] = PWM_MAX_DUTY / 2;
+	}
+}
+
+
+int main( void )
+{
+	int pendingFrame = -1;
+	int frame;
+	uint8_t lit[ NUM_CHANNELS ];
+	uint8_t i;
+
+	initOutputs();
+	pwmInit();
+	sampleOutputs( lit );
+	beginCycle( -1 );
+
+	for( frame = 0; frame < NUM_FRAMES; frame++ )
+	{
+		unsigned long ticks = FRAME_CYCLES * CYCLE_TICKS + random32() % CYCLE_TICKS;
+
+		randomFrame( frame );
+		pwmUpdate( (ledDuty_t const*) g_frames[ frame ] );
+		pendingFrame = frame;
+
+		while( ticks-- > 0 )
+		{
+			uint8_t begin;
+
+			if( TCCR2 & TIMER_CLOCK )
+			{
+				begin = timerTick();
+			}
+			else
+			{
+				// PWM cycles of the constant outputs
+				g_cycle.stopped = 1;
+				begin = g_cycle.ticks == CYCLE_TICKS;
+			}
+
+			pwmDither();
+
+			if( begin )
+			{
+				checkCycle();
+				beginCycle( pendingFrame );
+			}
+
+			sampleOutputs( lit );
+
+			for( i = 0; i < NUM_CHANNELS; i++ )
+			{
+				g_cycle.lit[ i ] += lit[ i ];
+			}
+
+			g_cycle.ticks += 1;
+		}
+	}
+
+	for( frame = 0; frame < NUM_FRAMES; frame++ )
+	{
+		if( g_checkedPerFrame[ frame ] == 0 )
+		{
+			fprintf( stderr, "frame %d not checked\n", frame );
+			return 1;
+		}
+	}
+
+	printf( "PWM_ENGINE=%d PWM_OUTPUT=%d PWM_STAGGER=%d PWM_DITHER_BITS=%d: %lu PWM cycles ok\n",
+	        PWM_ENGINE, PWM_OUTPUT, PWM_STAGGER, PWM_DITHER_BITS, g_checkedCycles );
+
+	return 0;
+}
@@ -3,24 +3,24 @@
  *
  * Platform: ATmega8 @ 8Mhz
  *
- * The basic idea is to rapidly switch an LED on and off in order to change its brightness. The LED
- * is switched on at the beginning of a PWM cycle and switched off later in that cycle (or not
- * switched off at all if maximum brightness is desired). Depending on how long the LED remains lit
- * in that cycle, it will appear brighter or darker. The proportion of "on" time to the length of
- * the complete PWM cycle is the so-called duty cycle.
- *
- * Since the LED is basically flickering, the PWM frequency has to be high enough to make the LED
- * appear to glow with constant brightness to the human eye. We use a PWM frequency of roughly
- * 100 Hz here, with each PWM cycle consisting of 256 steps (i.e. a temporal resolution of 8 bit).
- *
- * A hardware timer is generating an interrupt for each PWM step. The interrupt handler then
- * decides, based on the current position in the PWM cycle and the desired LED brightness, whether
- * to switch the LED on or off.
+ * The LEDs are dimmed by rapidly switching them on and off (see pwm.c for the details). The
+ * animations (see animations.c) set the desired LED brightness for each frame, a second hardware
+ * timer provides a millisecond time base for the frame periods of the animation modules. The
+ * animation programs are coroutines (see coroutine.h): when a frame is due, main() resumes the
+ * current program, which draws one frame and yields. The animations run by time, not by frame:
+ * a program advances one step per frame period of its module (or draws the frame of the current
+ * time, see animationTime()), so the frame rate can be lowered when the CPU falls behind without
+ * slowing the animation down.
  *
  * The human eye does not perceive linear changes in brightness as linear but rather
  * logarithmically. For a perceived linear change in LED brightness we thus need to map the desired
  * LED brightness to an appropriate PWM duty cycle by applying a power function. This mapping is
- * done using a precomputed lookup table.
+ * done using lookup tables which are generated at build time, one for each color channel so that
+ * the brightness of the different colors can be balanced (see tools/gengamma.c and the Makefile).
+ *
+ * When a module has finished, the next one is crossfaded in: for a few frames, both programs are
+ * running and their frames are blended (see TRANSITION_BITS). A push button on PD3 switches to the
+ * next animation module immediately (see button.c).
  */
 
 // clock frequency
@@ -29,276 +29,551 @@
 #endif
 
 #include "animations.h"
+#include "button.h"
+#include "gamma.h"
 #include "ledterne.h"
+#include "pwm.h"
+#include "script.h"
+#include "serial.h"
+#include "streams.h"
+#include "telemetry.h"
 
 #include <inttypes.h>
 #include <avr/io.h>
 #include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+#include <avr/sleep.h>
 #include <string.h>
 #include <util/delay.h>
 
 
-// LED outputs (connected to the anodes)
-#define PORT_0 PORTB
-#define PIN_R0 PB2
-#define PIN_G0 PB1
-#define PIN_B0 PB0
-#define PORT_1 PORTD
-#define PIN_R1 PD7
-#define PIN_G1 PD6
-#define PIN_B1 PD5
-#define PORT_2 PORTD
-#define PIN_R2 PD2
-#define PIN_G2 PD1
-#define PIN_B2 PD0
-#define PORT_3 PORTC
-#define PIN_R3 PC2
-#define PIN_G3 PC1
-#define PIN_B3 PC0
-#define PORT_4 PORTB
-#define PIN_R4 PB5
-#define PIN_G4 PB4
-#define PIN_B4 PB3
-
-// determine data direction register for port p
-#define DDR( p ) ( *( &p - 1 ) )
-
-
-// lookup table for converting LED intensities to PWM steps (brighter LED requires the output to
-// stay on for more steps)
-uint8_t g_pwm[ MAX_INTENSITY + 1 ] =
+// read a duty cycle from the gamma tables (in flash)
+#if PWM_DITHER_BITS > 0
+#define pgm_read_duty( addr ) pgm_read_word( addr )
+#else
+#define pgm_read_duty( addr ) pgm_read_byte( addr )
+#endif
+
+
+// flag for updating the frame (i.e. for advancing the color animation one step)
+volatile int g_frameUpdateRequired = 0;
+
+// time base: milliseconds since the start (wraps around after 65.536 s)
+static volatile uint16_t g_ticks = 0;
+
+// tick of the next frame (of any program), at which the timer interrupt sets g_frameUpdateRequired
+static volatile uint16_t g_nextFrameTick = 0;
+
+// time of the frame being drawn, relative to the start of its program (see animationTime())
+static uint16_t g_animationTime = 0;
+
+// a module's frame period is lowered to this multiple of its framePeriod at most, while its frames
+// come too late (see main())
+#define MAX_FRAME_PERIOD_FACTOR 4
+
+
+// frame scheduling statistics (see g_frameStats)
+enum
 {
-	  0,   1,   1,   1,   2,   2,   3,   3,
-	  4,   5,   6,   7,   9,  10,  12,  15,
-	 17,  21,  25,  30,  36,  43,  51,  61,
-	 73,  87, 104, 125, 149, 178, 213, 255,
+	FRAMES_LATE,      // frame updates that came too late for one or more frames
+	STEPS_CAUGHT_UP,  // program steps executed in addition to the first one of a frame
+	FRAMES_SKIPPED,   // missed frames that have been skipped
+	NUM_FRAME_STATS
 };
 
+// number of frames in each category (for measuring overruns in a simulation, see bench/)
+volatile uint16_t g_frameStats[ NUM_FRAME_STATS ];
 
+// the frame period of a program
 typedef struct
 {
-	uint8_t r;
-	uint8_t g;
-	uint8_t b;	
+	uint16_t period;   // ms
+	uint16_t nextTick; // tick of the next frame
 }
-ledIntensity_t;
+frameTimer_t;
 
-ledIntensity_t g_intensity[ NUM_PIXELS ];
 
-// flag for updating the frame (i.e. for advancing the color animation one step)
-volatile int g_frameUpdateRequired = 0;
+// power states (see g_powerStateFrames)
+enum
+{
+	POWER_PWM_RUNNING, // PWM timer interrupts (the CPU sleeps between them)
+	POWER_PWM_STOPPED, // constant outputs, the CPU sleeps until the next frame
+	NUM_POWER_STATES
+};
+
+// number of frames displayed in each power state (for measuring the power savings in a simulation,
+// see bench/)
+volatile uint16_t g_powerStateFrames[ NUM_POWER_STATES ];
+
+
+// The programs of the animation are either compiled natively or interpreted from their scripts (see
+// script.h and the Makefile), which draw the same frames. This is only for comparing the two (e.g.
+// with 'make bench'), new animations can simply be added as script modules.
+#ifndef ANIMATION_SCRIPTS
+#define ANIMATION_SCRIPTS 0
+#endif
+
+#if ANIMATION_SCRIPTS
+#if NUM_PIXELS != 5
+#error "the scripts are written for 5 pixels (see scripts.c)"
+#endif
+#define PROGRAM( name ) .programType = Script, .data = g_script##name
+#else
+#define PROGRAM( name ) .programType = name
+#endif
+
+// the animation: a list of modules which are played one after the other
+static AnimationModule const g_animation[] PROGMEM =
+{
+#if SERIAL_FRAMES
+	{
+		// frames sent by the PC, checked for new ones every 2 ms (see serial.c), always showing the
+		// latest one
+		.programType = Serial,
+		.repetitions = 1,
+		.framePeriod = 2,
+		.timeBased = 1,
+	},
+#endif
+	{
+		PROGRAM( ColoredConveyor ),
+		.repetitions = 12,
+		.framePeriod = 67,
+	},
+	{
+		PROGRAM( MixedColorBlending ),
+		.repetitions = 1,
+		.framePeriod = 67,
+	},
+	{
+		// pre-rendered (see STREAMS in the Makefile)
+		.programType = Stream,
+		.data = g_streamKnightRider,
+		.repetitions = 2,
+		.framePeriod = 133,
+	},
+	{
+		.programType = Rainbow,
+		.repetitions = 3,
+		.framePeriod = 33,
+		.timeBased = 1,
+	},
+	{
+		.programType = CandleFlicker,
+		.repetitions = 2,
+		.framePeriod = 20,
+		.timeBased = 1,
+	},
+#if 0
+	{
+		PROGRAM( TestDisplays ),
+		.repetitions = 1,
+		.framePeriod = 133,
+	},
+#endif
+};
+
+// Number of frames of the crossfade between two modules is 2^TRANSITION_BITS (the last one shows
+// the next module only). 0 disables crossfades.
+#ifndef TRANSITION_BITS
+#define TRANSITION_BITS 3
+#endif
+
+// transitions between modules (see g_transitions)
+enum
+{
+	TRANSITION_CROSSFADE, // crossfade completed
+	TRANSITION_CUT,       // crossfade aborted, because it did not fit into the frame period
+	NUM_TRANSITIONS
+};
+
+// number of transitions of each kind (for checking the crossfade's budget in a simulation, see
+// bench/)
+volatile uint16_t g_transitions[ NUM_TRANSITIONS ];
+
+
+// state of the currently running program and (during a crossfade) of the previous one
+static AnimationProgramStorage g_programs[ 2 ];
+
+// back buffers of the programs (fine LED intensities, see setPixelFine())
+static ledIntensity_t g_frames[ 2 ][ NUM_PIXELS ];
+
+// back buffer of the frame that is currently being drawn
+static ledIntensity_t* g_frame = g_frames[ 0 ];
+
+// flag for skipping the commit of frames that did not change
+static uint8_t g_frameChanged = 0;
+
+// crossfade: frame of the previous program, which is blended with the current one (share of the
+// current one: g_blendAlpha / 2^TRANSITION_BITS, 0 for no crossfade)
+static ledIntensity_t const* g_blendFrame;
+static uint8_t g_blendAlpha = 0;
+
+// flag for committing the first frame after a crossfade, even if it did not change
+static uint8_t g_frameBlended = 0;
+
+
+/**
+ * @brief Start drawing a new frame
+ *
+ * The back buffer still contains the previous frame, so only the pixels that change need to be set.
+ */
+void beginFrame( void )
+{
+	g_frameChanged = 0;
+}
+
+
+/**
+ * @brief Set RGB LED intensities of a pixel in the back buffer
+ *
+ * The new intensities become visible with the next commitFrame(). Intensities above MAX_INTENSITY
+ * are displayed at MAX_INTENSITY.
+ */
+void setPixel( uint8_t pixelIndex, uint8_t r, uint8_t g, uint8_t b )
+{
+	setPixelFine( pixelIndex,
+	              ( r <= MAX_INTENSITY ? r : MAX_INTENSITY ) << INTENSITY_FRACTION_BITS,
+	              ( g <= MAX_INTENSITY ? g : MAX_INTENSITY ) << INTENSITY_FRACTION_BITS,
+	              ( b <= MAX_INTENSITY ? b : MAX_INTENSITY ) << INTENSITY_FRACTION_BITS );
+}
 
 
 /**
- * @brief Set RGB LED intensities for display
+ * @brief Set fine RGB LED intensities of a pixel in the back buffer
+ *
+ * Like setPixel(), but in steps of 1 / 2^INTENSITY_FRACTION_BITS intensity (0 -
+ * MAX_FINE_INTENSITY), for fades that would step visibly between whole intensities. The back
+ * buffers always hold fine intensities, so crossfades between programs are finer, too.
  */
-void setIntensity( uint8_t pixelIndex, uint8_t r, uint8_t g, uint8_t b )
+void setPixelFine( uint8_t pixelIndex, uint8_t r, uint8_t g, uint8_t b )
 {
 	if( pixelIndex >= NUM_PIXELS )
 	{
 		return;
 	}
 
-	if( r <= MAX_INTENSITY )
-	{
-		g_intensity[ pixelIndex ].r = g_pwm[ r ];
-	}
-
-	if( g <= MAX_INTENSITY )
-	{
-		g_intensity[ pixelIndex ].g = g_pwm[ g ];
-	}
+	ledIntensity_t* pixel = &g_frame[ pixelIndex ];
 
-	if( b <= MAX_INTENSITY )
+	if( pixel->r != r || pixel->g != g || pixel->b != b )
 	{
-		g_intensity[ pixelIndex ].b = g_pwm[ b ];
+		pixel->r = r;
+		pixel->g = g;
+		pixel->b = b;
+		g_frameChanged = 1;
 	}
 }
 
 
 /**
- * @brief Interrupt handler for a single PWM step
+ * @brief Blend two frames: from + ( to - from ) * alpha / 2^TRANSITION_BITS
  *
- * This updates the LED outputs to achieve the currently selected intensities for each channel.
+ * There is no multiplication: each bit of alpha (starting with the lowest) halves the distance to
+ * either frame, i.e. TRANSITION_BITS additions and shifts per channel. (Not inlined, so that
+ * 'make bench' can profile it.)
  */
-ISR( TIMER2_COMP_vect )
+static void __attribute__(( noinline )) blendFrames( ledIntensity_t* out, ledIntensity_t const* from,
+                                                     ledIntensity_t const* to, uint8_t alpha )
 {
-	static uint8_t pwmStep = 0;
-
-	if( pwmStep < g_intensity[ 0 ].g ) { PORT_0 |= (1<<PIN_G0); } else { PORT_0 &= ~(1<<PIN_G0); }
-	if( pwmStep < g_intensity[ 0 ].r ) { PORT_0 |= (1<<PIN_R0); } else { PORT_0 &= ~(1<<PIN_R0); }
-	if( pwmStep < g_intensity[ 0 ].b ) { PORT_0 |= (1<<PIN_B0); } else { PORT_0 &= ~(1<<PIN_B0); }
-
-	if( pwmStep < g_intensity[ 1 ].g ) { PORT_1 |= (1<<PIN_G1); } else { PORT_1 &= ~(1<<PIN_G1); }
-	if( pwmStep < g_intensity[ 1 ].r ) { PORT_1 |= (1<<PIN_R1); } else { PORT_1 &= ~(1<<PIN_R1); }
-	if( pwmStep < g_intensity[ 1 ].b ) { PORT_1 |= (1<<PIN_B1); } else { PORT_1 &= ~(1<<PIN_B1); }
-
-	if( pwmStep < g_intensity[ 2 ].g ) { PORT_2 |= (1<<PIN_G2); } else { PORT_2 &= ~(1<<PIN_G2); }
-	if( pwmStep < g_intensity[ 2 ].r ) { PORT_2 |= (1<<PIN_R2); } else { PORT_2 &= ~(1<<PIN_R2); }
-	if( pwmStep < g_intensity[ 2 ].b ) { PORT_2 |= (1<<PIN_B2); } else { PORT_2 &= ~(1<<PIN_B2); }
+	uint8_t const* a = &from[ 0 ].r;
+	uint8_t const* b = &to[ 0 ].r;
+	uint8_t* o = &out[ 0 ].r;
+	uint8_t i, bit;
 
-	if( pwmStep < g_intensity[ 3 ].g ) { PORT_3 |= (1<<PIN_G3); } else { PORT_3 &= ~(1<<PIN_G3); }
-	if( pwmStep < g_intensity[ 3 ].r ) { PORT_3 |= (1<<PIN_R3); } else { PORT_3 &= ~(1<<PIN_R3); }
-	if( pwmStep < g_intensity[ 3 ].b ) { PORT_3 |= (1<<PIN_B3); } else { PORT_3 &= ~(1<<PIN_B3); }
+	for( i = 0; i < 3 * NUM_PIXELS; i++ )
+	{
+		uint8_t v = a[ i ];
 
-	if( pwmStep < g_intensity[ 4 ].g ) { PORT_4 |= (1<<PIN_G4); } else { PORT_4 &= ~(1<<PIN_G4); }
-	if( pwmStep < g_intensity[ 4 ].r ) { PORT_4 |= (1<<PIN_R4); } else { PORT_4 &= ~(1<<PIN_R4); }
-	if( pwmStep < g_intensity[ 4 ].b ) { PORT_4 |= (1<<PIN_B4); } else { PORT_4 &= ~(1<<PIN_B4); }
+		for( bit = 0; bit < TRANSITION_BITS; bit++ )
+		{
+			v = ( v + ( alpha & ( 1 << bit ) ? b[ i ] : a[ i ] ) ) >> 1;
+		}
 
-	// Since it is an uint8, this counter overflows at 255. This is desired behaviour. It makes the
-	// counter run from 0 to 255, i.e. it makes a complete PWM cycle consist of 256 single steps.
-	pwmStep += 1;
+		o[ i ] = v;
+	}
 }
 
 
 /**
- * @brief Interrupt handler for frame tick
+ * @brief Display the frame in the back buffer
  *
- * This signals the main program that the animations needs to be advanced one step
+ * This maps all LED intensities to PWM duty cycles in one go and hands them to the PWM, which
+ * switches to the new frame at the beginning of its next cycle (so a PWM cycle never shows parts of
+ * two different frames). Fine intensities above MAX_FINE_INTENSITY are displayed at
+ * MAX_FINE_INTENSITY. During a crossfade, the frame is blended with the previous program's frame
+ * first.
  */
-ISR( TIMER1_COMPA_vect )
+void commitFrame( void )
 {
-	g_frameUpdateRequired = 1;
+	ledIntensity_t const* frame = g_frame;
+	ledIntensity_t blended[ NUM_PIXELS ];
+
+	if( g_blendAlpha )
+	{
+		blendFrames( blended, g_blendFrame, g_frame, g_blendAlpha );
+		frame = blended;
+	}
+	else if( !g_frameChanged && !g_frameBlended )
+	{
+		return;
+	}
+
+	g_frameBlended = g_blendAlpha != 0;
+
+	ledDuty_t duty[ NUM_PIXELS ];
+
+	// flat views of the frame and the duty cycles (all channels of all pixels)
+	uint8_t const* in = &frame[ 0 ].r;
+	pwmDuty_t* out = &duty[ 0 ].r;
+	uint8_t channel = 0;
+	uint8_t i;
+
+	for( i = 0; i < 3 * NUM_PIXELS; i++ )
+	{
+		uint8_t v = in[ i ] <= MAX_FINE_INTENSITY ? in[ i ] : MAX_FINE_INTENSITY;
+		out[ i ] = pgm_read_duty( &g_gamma[ channel ][ v ] );
+
+		channel = channel < 2 ? channel + 1 : 0;
+	}
+
+	pwmUpdate( duty );
 }
 
 
 /**
- * @Brief Set up timer that triggers an interrupt for every single PWM step
+ * @brief Interrupt handler for the time base (every millisecond)
+ *
+ * This signals the main program when the next frame is due.
  */
-void pwmTimerInit()
+TELEMETRY_ISR( TIMER1_COMPA_vect, TELEMETRY_ISR_TICK )
 {
-	// prescaler for 8 bit timer: 1/8 clock frequency
-	TCCR2 |= (1<<CS21);
-
-	// Clear Timer on Compare (CTC):
-	// reset counter TCNT2 when it reaches the value in OCR2
-	TCCR2 |= (1<<WGM21);
-
-	// frequency of timer interrupts: ca. 25.6 kHz
-	//
-	//    f = F_CPU / (PRESCALER * (1 + OCR2))
-	// OCR2 = F_CPU / (f * PRESCALER) - 1
-	//
-	// Since a complete PWM cycle consists of 256 single steps (see the PWM step counter in the
-	// associated interrupt handler) this leaves us with a PWM frequency of roughly
-	//
-	// f_PWM = 25.6 kHz / 256
-	//       = 100 Hz .
-	//
-	OCR2 = 38;
+	g_ticks += 1;
+	telemetryTick();
 
-	// enable interrupt on reaching the reference value in OCR2
-	TIMSK |= (1<<OCIE2);
+	if( g_ticks == g_nextFrameTick )
+	{
+		g_frameUpdateRequired = 1;
+	}
 }
 
 
 void animationTimerInit()
 {
-	// prescaler for 16 bit timer: 1/1024 clock frequency
-	TCCR1B |= (1<<CS12) | (1<<CS10);
+	// prescaler for 16 bit timer: 1/64 clock frequency
+	TCCR1B |= (1<<CS11) | (1<<CS10);
 
 	// Clear Timer on Compare (CTC):
 	// reset counter TCNT1 when it reaches the value in OCRA1
 	TCCR1B |= (1<<WGM12);
 
-	// frequency of timer interrupts: ca. 15 Hz
+	// frequency of timer interrupts: 1 kHz
 	//
 	//     f = F_CPU / (PRESCALER * (1 + OCR1A))
 	// OCRA1 = F_CPU / (f * PRESCALER) - 1
-	OCR1A = 520;
+	OCR1A = F_CPU / ( 1000L * 64 ) - 1;
 
 	// enable interrupt on reaching the reference value in OCR1A
 	TIMSK |= (1<<OCIE1A);
 }
 
 
-void setAnimationTimer( uint16_t v )
+/**
+ * @brief Current tick of the time base
+ */
+static uint16_t ticks( void )
 {
-	OCR1A = v;
+	cli();
+	uint16_t t = g_ticks;
+	sei();
+
+	return t;
 }
 
 
-int main( void )
+/**
+ * @brief Set the tick at which the main program is woken up for the next frame
+ *
+ * If that tick has already passed (or is passing right now), the frame update is signalled right
+ * away.
+ */
+static void scheduleFrameUpdate( uint16_t tick )
 {
-	// configure LED pins as outputs, disable by default
-	DDR( PORT_0 ) |=    (1<<PIN_R0) | (1<<PIN_G0) | (1<<PIN_B0);
-	PORT_0        &= ~( (1<<PIN_R0) | (1<<PIN_G0) | (1<<PIN_B0) );
-	DDR( PORT_1 ) |=    (1<<PIN_R1) | (1<<PIN_G1) | (1<<PIN_B1);
-	PORT_1        &= ~( (1<<PIN_R1) | (1<<PIN_G1) | (1<<PIN_B1) );
-	DDR( PORT_2 ) |=    (1<<PIN_R2) | (1<<PIN_G2) | (1<<PIN_B2);
-	PORT_2        &= ~( (1<<PIN_R2) | (1<<PIN_G2) | (1<<PIN_B2) );
-	DDR( PORT_3 ) |=    (1<<PIN_R3) | (1<<PIN_G3) | (1<<PIN_B3);
-	PORT_3        &= ~( (1<<PIN_R3) | (1<<PIN_G3) | (1<<PIN_B3) );
-	DDR( PORT_4 ) |=    (1<<PIN_R4) | (1<<PIN_G4) | (1<<PIN_B4);
-	PORT_4        &= ~( (1<<PIN_R4) | (1<<PIN_G4) | (1<<PIN_B4) );
-
-	pwmTimerInit();
-	animationTimerInit();
+	cli();
+	g_nextFrameTick = tick;
 
-	uint8_t i;
+	if( (int16_t) ( g_ticks - tick ) >= 0 )
+	{
+		g_frameUpdateRequired = 1;
+	}
+	sei();
+}
+
+
+/**
+ * @brief Number of frames of a program that are due at tick now
+ *
+ * 0 if the next frame is not due yet, 1 if it is, more if frames have been missed. This advances the
+ * timer to the next frame after now.
+ */
+static uint8_t frameTimerDue( frameTimer_t* timer, uint16_t now )
+{
+	uint8_t due = 0;
 
-	// intially switch all pixels off
-	for( i = 0; i < NUM_PIXELS; i++ )
+	while( (int16_t) ( now - timer->nextTick ) >= 0 )
 	{
-		setIntensity( i, 0, 0, 0 );
+		timer->nextTick += timer->period;
+		due += due < 255;
 	}
 
-	// globally enable interrupts
-	sei();
+	return due;
+}
+
+
+/**
+ * @brief Number of steps a program has to advance to reach tick now
+ *
+ * A program that is not time-based advances one step per framePeriod of its module (the period of
+ * its step timer) since its start, however many frames have been displayed in the meantime. A
+ * time-based program (step timer period 0) draws the frame of the current time in a single step.
+ */
+static uint8_t stepsDue( frameTimer_t* stepTimer, uint16_t now )
+{
+	return stepTimer->period > 0 ? frameTimerDue( stepTimer, now ) : 1;
+}
+
+
+/**
+ * @brief Milliseconds since the current program has been started
+ *
+ * This is the time of the frame being drawn (the tick at which its update started), so all pixels
+ * of a frame see the same time.
+ */
+uint16_t animationTime( void )
+{
+	return g_animationTime;
+}
 
 
-	AnimationModule const animation[] =
+typedef uint8_t (*programExecuteFunc_t)( void* );
+
+/**
+ * @brief Reset the program of a module, so that it starts from the beginning when it is resumed
+ *
+ * Returns the program's execute function.
+ */
+static programExecuteFunc_t startProgram( AnimationModule const* module, AnimationProgramStorage* prog )
+{
+	switch( module->programType )
 	{
-		{
-			.programType = ColoredConveyor,
-			.repetitions = 12,
-			.timerPeriod = 520,
-		},
-		{
-			.programType = MixedColorBlending,
-			.repetitions = 1,
-			.timerPeriod = 520,
-		},
-		{
-			.programType = KnightRider,
-			.repetitions = 2,
-			.timerPeriod = 520 * 2,
-		},
-#if 0
-		{
-			.programType = TestDisplays,
-			.repetitions = 1,
-			.timerPeriod = 520 * 2,
-		},
+		case MixedColorBlending:
+			MixedColorBlending_init( &prog->mixedColorBlending );
+			return (programExecuteFunc_t) &MixedColorBlending_execute;
+
+		case KnightRider:
+			KnightRider_init( &prog->knightRider );
+			return (programExecuteFunc_t) &KnightRider_execute;
+
+		case ColoredConveyor:
+			ColoredConveyor_init( &prog->coloredConveyor );
+			return (programExecuteFunc_t) &ColoredConveyor_execute;
+
+		case TestDisplays:
+			TestDisplays_init( &prog->testDisplays );
+			return (programExecuteFunc_t) &TestDisplays_execute;
+
+		case Rainbow:
+			Rainbow_init( &prog->rainbow );
+			return (programExecuteFunc_t) &Rainbow_execute;
+
+		case CandleFlicker:
+			CandleFlicker_init( &prog->candleFlicker );
+			return (programExecuteFunc_t) &CandleFlicker_execute;
+
+		case Script:
+			Script_init( &prog->script, module->data );
+			return (programExecuteFunc_t) &Script_execute;
+
+#if SERIAL_FRAMES
+		case Serial:
+			return (programExecuteFunc_t) &Serial_execute;
 #endif
-	};
+
+		case Stream:
+		default:
+			Stream_init( &prog->stream, module->data );
+			return (programExecuteFunc_t) &Stream_execute;
+	}
+}
+
+
+int main( void )
+{
+	// before pwmInit(), which keeps the button's pull-up, TXD and RXD
+	buttonInit();
+	telemetryInit();
+	serialInit();
+	pwmInit();
+	animationTimerInit();
+
+	// globally enable interrupts
+	sei();
+
+	// the CPU sleeps whenever it is waiting for an interrupt, the timers keep running
+	set_sleep_mode( SLEEP_MODE_IDLE );
+
 
 	// compute number of modules in the animation
-	uint8_t numModules = sizeof( animation ) / sizeof( AnimationModule );
+	uint8_t numModules = sizeof( g_animation ) / sizeof( AnimationModule );
 
 	uint8_t currentModuleIndex = numModules - 1; // HACK: needed to start with the first module
 	uint8_t repetitions = 0;
-	AnimationModule const* currentModule = NULL;
-	void* currentProgram = NULL;
+	AnimationModule currentModule;
+
+	// the current program and (during a crossfade) the previous one, each with its own frame period
+	// and step timer (see stepsDue())
+	uint8_t current = 0;
+	programExecuteFunc_t programExecuteFunc = NULL;
+	programExecuteFunc_t previousExecuteFunc = NULL;
+	frameTimer_t frameTimers[ 2 ] = { { 1, 0 }, { 1, 0 } };
+	frameTimer_t stepTimers[ 2 ] = { { 0, 0 }, { 0, 0 } };
+	uint16_t programStarts[ 2 ] = { 0, 0 };
+
+	// remaining frames of the crossfade
+	uint8_t transition = 0;
+	uint8_t cut = 1;
 
-	void (*programDestroyFunc)( void* ) = NULL;
-	uint8_t (*programExecuteFunc)( void* ) = NULL;
+	scheduleFrameUpdate( 0 );
 
 	while( 1 )
 	{
+		pwmDither();
+		telemetryReport();
+
+		// The button switches to the next module right away (without a crossfade): its program
+		// draws the first frame now instead of at the next frame tick, which becomes visible with
+		// the next PWM cycle.
+		if( g_buttonPressed )
+		{
+			g_buttonPressed = 0;
+			repetitions = 0;
+			cut = 1;
+			frameTimers[ current ].nextTick = ticks();
+			g_frameUpdateRequired = 1;
+		}
+
 		if( g_frameUpdateRequired )
 		{
 			g_frameUpdateRequired = 0;
 
+			uint16_t frameStart = telemetryTimestamp();
+
+			uint16_t now = ticks();
+			uint8_t due = frameTimerDue( &frameTimers[ current ], now );
+			uint8_t previousDue = transition > 0 && frameTimerDue( &frameTimers[ current ^ 1 ], now );
+
 			// load next module if the current one has finished playing completely
-			if( repetitions == 0 )
+			if( due && repetitions == 0 )
 			{
-				// destroy the previous module's program if one exists
-				if( currentProgram )
-				{
-					(*programDestroyFunc)( currentProgram );
-				}
-
 				// select next module (start at beginning if we reached the module list's end)
 				currentModuleIndex += 1;
 				if( currentModuleIndex == numModules )
@@ -306,50 +581,161 @@ int main( void )
 					currentModuleIndex = 0;
 				}
 
-				currentModule = &animation[ currentModuleIndex ];
-				repetitions = currentModule->repetitions;
+				memcpy_P( &currentModule, &g_animation[ currentModuleIndex ], sizeof( currentModule ) );
+				repetitions = currentModule.repetitions;
+
+				// Crossfade: the previous program keeps running (at its own frame period) in the
+				// other storage and back buffer. The new program's back buffer starts with the
+				// previous program's frame. Otherwise, the new program replaces the previous one's
+				// state.
+				transition = 0;
+
+				if( !cut && TRANSITION_BITS > 0 )
+				{
+					previousExecuteFunc = programExecuteFunc;
+					current ^= 1;
+					memcpy( g_frames[ current ], g_frames[ current ^ 1 ], sizeof( g_frames[ 0 ] ) );
+					transition = ( 1 << TRANSITION_BITS ) - 1;
+
+					// the previous program's frame is due as well
+					previousDue = 1;
+				}
+
+				cut = 0;
+				programExecuteFunc = startProgram( &currentModule, &g_programs[ current ] );
+				programStarts[ current ] = now;
+
+				// the new program's first frame and step are due now
+				frameTimers[ current ].period = currentModule.framePeriod;
+				frameTimers[ current ].nextTick = now + currentModule.framePeriod;
+				stepTimers[ current ].period = currentModule.timeBased ? 0
+				                             : currentModule.framePeriod;
+				stepTimers[ current ].nextTick = now;
+				due = 1;
+			}
+
+			// deadline and budget of the current program's frame, before its frame period is
+			// adapted below
+			uint16_t deadline = frameTimers[ current ].nextTick - frameTimers[ current ].period;
+			uint16_t budget = frameTimers[ current ].period / 2;
+
+			if( previousDue )
+			{
+				// advance the previous program to the current time
+				uint8_t steps = stepsDue( &stepTimers[ current ^ 1 ], now );
+
+				g_frame = g_frames[ current ^ 1 ];
+				g_animationTime = now - programStarts[ current ^ 1 ];
+				beginFrame();
+
+				while( steps-- > 0 )
+				{
+					(*previousExecuteFunc)( &g_programs[ current ^ 1 ] );
+				}
+			}
+
+			if( due )
+			{
+				// Missed frames are skipped: the next frame shows the animation at the current
+				// time, so its speed does not depend on the frame period. While the frames come too
+				// late, the frame rate is lowered by a third (down to a quarter of the module's),
+				// and raised back step by step when they are on time again.
+				uint8_t missed = due - 1;
+				uint8_t steps = stepsDue( &stepTimers[ current ], now );
+				uint16_t period = frameTimers[ current ].period;
+				uint16_t maxPeriod = MAX_FRAME_PERIOD_FACTOR * currentModule.framePeriod;
+
+				if( missed > 0 )
+				{
+					period += ( period >> 1 ) + 1;
+					frameTimers[ current ].period = period < maxPeriod ? period : maxPeriod;
+
+					g_frameStats[ FRAMES_LATE ] += 1;
+					g_frameStats[ FRAMES_SKIPPED ] += missed;
+				}
+				else if( period > currentModule.framePeriod )
+				{
+					frameTimers[ current ].period = period - 1;
+				}
+
+				if( steps > 1 )
+				{
+					g_frameStats[ STEPS_CAUGHT_UP ] += steps - 1;
+				}
+
+				// resume the current module's program until it has reached the current time (only
+				// the last step's frame is displayed)
+				g_frame = g_frames[ current ];
+				g_animationTime = now - programStarts[ current ];
+				beginFrame();
 
-				// instantiate the current module's program
-				switch( currentModule->programType )
+				while( steps-- > 0 && repetitions > 0 )
 				{
-					case MixedColorBlending:
-						currentProgram = MixedColorBlending_create();
-						programDestroyFunc = &MixedColorBlending_destroy;
-						programExecuteFunc = &MixedColorBlending_execute;
-						break;
-
-					case KnightRider:
-						currentProgram = KnightRider_create();
-						programDestroyFunc = &KnightRider_destroy;
-						programExecuteFunc = &KnightRider_execute;
-						break;
-
-					case ColoredConveyor:
-						currentProgram = ColoredConveyor_create();
-						programDestroyFunc = &ColoredConveyor_destroy;
-						programExecuteFunc = &ColoredConveyor_execute;
-						break;
-
-					case TestDisplays:
-						currentProgram = TestDisplays_create();
-						programDestroyFunc = &TestDisplays_destroy;
-						programExecuteFunc = &TestDisplays_execute;
-						break;
+					if( (*programExecuteFunc)( &g_programs[ current ] ) )
+					{
+						repetitions -= 1;
+					}
+				}
+			}
 
+			if( due || previousDue )
+			{
+				if( transition > 0 )
+				{
+					g_blendFrame = g_frames[ current ^ 1 ];
+					g_blendAlpha = ( 1 << TRANSITION_BITS ) - transition;
 				}
 
-				setAnimationTimer( currentModule->timerPeriod );
+				g_frame = g_frames[ current ];
+				commitFrame();
+				g_blendAlpha = 0;
+
+				g_powerStateFrames[ pwmStopped() ? POWER_PWM_STOPPED : POWER_PWM_RUNNING ] += 1;
 			}
 
-			// execute the current module's program
-			uint8_t programFinished = (*programExecuteFunc)( currentProgram );
+			if( due && transition > 0 )
+			{
+				transition -= 1;
+
+				// Both programs and the blending have to fit into half of the frame period (the
+				// rest is left for the PWM interrupts), otherwise cut to the new program.
+				if( (uint16_t) ( ticks() - deadline ) > budget )
+				{
+					transition = 0;
+					g_transitions[ TRANSITION_CUT ] += 1;
+				}
+				else if( transition == 0 )
+				{
+					g_transitions[ TRANSITION_CROSSFADE ] += 1;
+				}
+			}
 
+			// wake up for the next frame of either program
+			uint16_t nextTick = frameTimers[ current ].nextTick;
 
-			if( programFinished )
+			if( transition > 0 && (int16_t) ( frameTimers[ current ^ 1 ].nextTick - nextTick ) < 0 )
 			{
-				repetitions -= 1;
+				nextTick = frameTimers[ current ^ 1 ].nextTick;
 			}
+
+			scheduleFrameUpdate( nextTick );
+
+			telemetryFrame( frameStart, due );
+		}
+
+		// Sleep until the next interrupt if there is nothing left to do. Interrupts are disabled
+		// while checking, and sleep_cpu() is executed right after sei() before any pending
+		// interrupt, so a wake-up cannot get lost in between.
+		cli();
+		if( !g_frameUpdateRequired && !g_buttonPressed && !pwmDitherPending()
+		    && !telemetryReportPending() )
+		{
+			sleep_enable();
+			sei();
+			sleep_cpu();
+			sleep_disable();
 		}
+		sei();
 	}
 
 	return 0;
@@ -4,9 +4,32 @@
 #include <inttypes.h>
 
 #define MAX_INTENSITY 31
+
+// fractional bits of the fine intensities of setPixelFine() (see the Makefile), which are mapped
+// to PWM duty cycles by a gamma table of the same depth
+#ifndef INTENSITY_FRACTION_BITS
+#define INTENSITY_FRACTION_BITS 2
+#endif
+
+#if INTENSITY_FRACTION_BITS < 0 || INTENSITY_FRACTION_BITS > 3
+#error "INTENSITY_FRACTION_BITS must be 0 - 3"
+#endif
+
+#define MAX_FINE_INTENSITY ( MAX_INTENSITY << INTENSITY_FRACTION_BITS )
+
+// number of pixels (see the Makefile), more than 5 need the shift register output (see pwm.h)
+#ifndef NUM_PIXELS
 #define NUM_PIXELS 5
+#endif
+
+void beginFrame( void );
+void setPixel( uint8_t pixelIndex, uint8_t r, uint8_t g, uint8_t b );
+void setPixelFine( uint8_t pixelIndex, uint8_t r, uint8_t g, uint8_t b );
+void commitFrame( void );
 
-void setIntensity( uint8_t pixelIndex, uint8_t r, uint8_t g, uint8_t b );
+// milliseconds since the current program has been started (wraps around after 65.536 s), for
+// programs that compute their frames from the time instead of counting them
+uint16_t animationTime( void );
 
 
 #endif // LEDTERNE_H_
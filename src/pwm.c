@@ -0,0 +1,1133 @@
+/**
+ * Software PWM for an array of RGB LEDs
+ *
+ * The basic idea is to rapidly switch an LED on and off in order to change its brightness. The LED
+ * is switched on at the beginning of a PWM cycle and switched off later in that cycle (or not
+ * switched off at all if maximum brightness is desired). Depending on how long the LED remains lit
+ * in that cycle, it will appear brighter or darker. The proportion of "on" time to the length of
+ * the complete PWM cycle is the so-called duty cycle.
+ *
+ * Since the LED is basically flickering, the PWM frequency has to be high enough to make the LED
+ * appear to glow with constant brightness to the human eye. We use a PWM frequency of roughly
+ * 100 Hz here, with each PWM cycle consisting of 256 steps (i.e. a temporal resolution of 8 bit).
+ *
+ * The LED outputs are described by a table (see g_channels). Whenever the duty cycles change,
+ * pwmUpdate() compiles them into complete port values, so the interrupt handlers never deal with
+ * single channels but just copy prepared values to PORTB, PORTC and PORTD. Their cost thus does not
+ * depend on the number of channels.
+ *
+ * The pins of the ATmega8 are enough for 5 pixels. For more (see NUM_PIXELS in the Makefile), the
+ * LEDs are connected to a chain of 74HC595 shift registers instead (PWM_OUTPUT_SHIFT, see
+ * PWM_OUTPUT in pwm.h). The port values are then the contents of the shift registers, which the
+ * interrupt handlers shift out over the SPI in a single burst and latch (see setPorts()). A burst
+ * takes ca. 20 CPU cycles per shift register, so here the cost of the interrupt handlers does grow
+ * with the number of pixels ('make benchpixels' reports it).
+ *
+ * There are three engines for generating the PWM signals (see PWM_ENGINE in pwm.h):
+ *
+ * PWM_ENGINE_STEP: A hardware timer is generating an interrupt for each PWM step. The duty cycles
+ * are compiled into a run-length table of port values: each entry holds from its PWM step until the
+ * step of the next entry. The interrupt handler only compares the current step with the step of the
+ * next entry and outputs the entry on a match. This is simple, but the 25.6k interrupts per second
+ * still take up a considerable amount of CPU time. PWM_ASM (see pwm.h) replaces the interrupt
+ * handler with a version in assembly that keeps its state in registers (see pwmisr.S).
+ *
+ * PWM_ENGINE_BAM: Bit angle modulation (also known as binary code modulation). Instead of switching
+ * an LED on for a single consecutive period, a PWM cycle is split into 8 periods, one for each bit
+ * of the 8 bit duty cycle. Each period lasts twice as long as the previous one (1, 2, 4, ... 128
+ * timer ticks) and the LED is lit during a period if the corresponding bit of its duty cycle is
+ * set. The sum of the "on" periods thus equals the duty cycle. This needs only 8 interrupts per PWM
+ * cycle and the output values for each bit (so-called bit planes) can be computed in advance, which
+ * leaves the interrupt handler with nothing to do but to copy them to the output ports.
+ *
+ * PWM_ENGINE_EVENT: Only generate interrupts when an output actually has to change. This uses the
+ * same table as PWM_ENGINE_STEP, but the timer runs through a complete PWM cycle on its own: The
+ * timer overflow at the beginning of a PWM cycle outputs the first entry (all LEDs with a non-zero
+ * duty cycle switched on), and the output compare interrupt is set up to fire at the step of the
+ * next entry only. LEDs with equal duty cycles share an entry, so there are at most 16 interrupts
+ * per PWM cycle.
+ *
+ * With PWM_STAGGER (see pwm.h), the STEP and EVENT engines do not switch on all LEDs at the
+ * beginning of a PWM cycle. Each channel has its own switch-on step instead (see staggerInit()),
+ * from which it is lit for the number of steps of its duty cycle, wrapping around at the end of the
+ * PWM cycle. The duty cycles stay the same, but the LEDs no longer draw their current all at once,
+ * which lowers the peak (and RMS) current from the supply. This needs up to two events per channel
+ * in the schedule ('make benchstagger' reports the current profile with and without).
+ *
+ * Duty cycles can have a fractional part (see PWM_DITHER_BITS in pwm.h), which gives a finer
+ * resolution especially for very dark LEDs, where a single PWM step is a clearly visible change in
+ * brightness. The engines only output whole steps, so the fractional part is dithered over
+ * successive PWM cycles: for each channel, the fractional parts not output yet are accumulated,
+ * and whenever they add up to a whole step, the channel is lit one step longer in the next PWM
+ * cycle (first-order error diffusion, see ditherStep()). Averaged over a few PWM cycles, the
+ * on-time equals the exact duty cycle. The interrupt handlers only signal the beginning of each
+ * PWM cycle, the next cycle is compiled by pwmDither() in the main loop, so this does not require
+ * any additional interrupts. Note that a channel with a small fractional part is lit one step
+ * longer only every few PWM cycles (e.g. every 16th for 1/16 step), which would be visible as
+ * flicker of dark LEDs, so the gamma tables only use half steps there (see tools/gengamma.c).
+ *
+ * If all LEDs are either off or at maximum brightness (e.g. while a program pauses in the dark),
+ * all PWM cycles would output the same constant port values. In this case, the interrupt handler
+ * outputs them at the beginning of the PWM cycle and stops the timer. It is restarted by the next
+ * pwmUpdate() with varying outputs, so the CPU can sleep until the next frame.
+ */
+
+// clock frequency
+#ifndef F_CPU
+#define F_CPU 8000000L
+#endif
+
+#include "pwm.h"
+#include "pwmregs.h"
+#include "serial.h"
+#include "telemetry.h"
+
+#include <inttypes.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+
+#define NUM_CHANNELS ( 3 * NUM_PIXELS )
+
+#if PWM_OUTPUT == PWM_OUTPUT_PINS
+
+// indices of the LED ports
+enum
+{
+	LED_PORT_B,
+	LED_PORT_C,
+	LED_PORT_D,
+	NUM_LED_PORTS
+};
+
+// a single LED output
+typedef struct
+{
+	uint8_t port;
+	uint8_t mask;
+}
+pwmChannel_t;
+
+// The telemetry build needs TXD (PD1) for the USART, so the green LED of pixel 2 is not driven
+// then (an output without pin). The same goes for the frame streaming with RXD (PD0) and blue.
+#if TELEMETRY
+#define PIXEL_2_G 0
+#else
+#define PIXEL_2_G (1<<PD1)
+#endif
+
+#if SERIAL_FRAMES
+#define PIXEL_2_B 0
+#else
+#define PIXEL_2_B (1<<PD0)
+#endif
+
+// LED outputs (connected to the anodes), in the same order as the duty cycles of all pixels
+static pwmChannel_t const g_channels[ NUM_CHANNELS ] =
+{
+	{ LED_PORT_B, (1<<PB2) }, { LED_PORT_B, (1<<PB1) }, { LED_PORT_B, (1<<PB0) }, // pixel 0: R G B
+	{ LED_PORT_D, (1<<PD7) }, { LED_PORT_D, (1<<PD6) }, { LED_PORT_D, (1<<PD5) }, // pixel 1
+	{ LED_PORT_D, (1<<PD2) }, { LED_PORT_D, PIXEL_2_G }, { LED_PORT_D, PIXEL_2_B }, // pixel 2
+	{ LED_PORT_C, (1<<PC2) }, { LED_PORT_C, (1<<PC1) }, { LED_PORT_C, (1<<PC0) }, // pixel 3
+	{ LED_PORT_B, (1<<PB5) }, { LED_PORT_B, (1<<PB4) }, { LED_PORT_B, (1<<PB3) }, // pixel 4
+};
+
+// index of the port of a channel's output
+static inline uint8_t channelPort( uint8_t channel )
+{
+	return g_channels[ channel ].port;
+}
+
+// bit mask of a channel's output within its port
+static inline uint8_t channelMask( uint8_t channel )
+{
+	return g_channels[ channel ].mask;
+}
+
+#elif PWM_OUTPUT == PWM_OUTPUT_SHIFT
+
+// Chain of 74HC595 shift registers: DS of the first register on MOSI (PB3), Q7S of each register
+// on DS of the next one, SHCP of all registers on SCK (PB5), STCP of all registers on SS (PB2),
+// /OE to GND and /MR to VCC. The LEDs are connected in the same order as the duty cycles of all
+// pixels: channel i to output Q(i % 8) of register i / 8. Each register is an LED port here.
+#define NUM_LED_PORTS ( ( NUM_CHANNELS + 7 ) / 8 )
+
+// The burst has to be finished before the next PWM interrupt, which may come ca. 256 CPU cycles
+// after the previous one.
+#if NUM_LED_PORTS > 8
+#error "the shift registers of more than 21 pixels cannot be loaded between two PWM interrupts"
+#endif
+
+// index of the port (shift register) of a channel's output
+static inline uint8_t channelPort( uint8_t channel )
+{
+	return channel >> 3;
+}
+
+// bit mask of a channel's output within its shift register
+static inline uint8_t channelMask( uint8_t channel )
+{
+	return 1 << ( channel & 7 );
+}
+
+#else
+#error "Unknown PWM_OUTPUT"
+#endif
+
+// output values of all LED ports
+typedef struct
+{
+	uint8_t port[ NUM_LED_PORTS ];
+}
+portState_t;
+
+// output values of the non-LED pins (which need to be preserved when writing a whole port)
+static portState_t g_idlePorts;
+
+#if PWM_DITHER_BITS > 0
+
+// mask for the fractional part of a duty cycle
+#define DITHER_MASK ( ( 1 << PWM_DITHER_BITS ) - 1 )
+
+// duty cycles of all channels (in the same order as g_channels), as given to pwmUpdate()
+static pwmDuty_t g_duty[ NUM_CHANNELS ];
+
+// accumulated fractional parts of the duty cycles which have not been output yet
+static uint8_t g_ditherError[ NUM_CHANNELS ];
+
+// flag for duty cycles with a fractional part (otherwise all PWM cycles are the same)
+static uint8_t g_dithering = 0;
+
+// flag for the beginning of a PWM cycle (set by the interrupt handlers)
+static volatile uint8_t g_pwmCycleStarted = 0;
+
+#endif
+
+// flag for a stopped PWM timer (the outputs are constant)
+static volatile uint8_t g_pwmStopped = 0;
+
+
+// whether successive PWM cycles of the current duty cycles differ
+static inline uint8_t isDithering( void )
+{
+#if PWM_DITHER_BITS > 0
+	return g_dithering;
+#else
+	return 0;
+#endif
+}
+
+
+/**
+ * @brief Stop the PWM timer (from its interrupt handler), the outputs keep their current values
+ */
+static inline void pwmStop( void )
+{
+	TCCR2 &= ~( (1<<CS22) | (1<<CS21) | (1<<CS20) );
+	g_pwmStopped = 1;
+}
+
+
+#if PWM_OUTPUT == PWM_OUTPUT_PINS
+
+static inline void setPorts( portState_t const* s )
+{
+	PORTB = s->port[ LED_PORT_B ];
+	PORTC = s->port[ LED_PORT_C ];
+	PORTD = s->port[ LED_PORT_D ];
+}
+
+#else
+
+/**
+ * @brief Shift the port values out to the shift registers and latch them
+ *
+ * The value for the last register of the chain goes first. The SPI runs at half the CPU clock,
+ * i.e. a byte takes 16 CPU cycles. The outputs change at the end of the burst (when they are
+ * latched), so all PWM events are delayed by the same time.
+ */
+static inline void setPorts( portState_t const* s )
+{
+	uint8_t i = NUM_LED_PORTS;
+
+	while( i-- > 0 )
+	{
+		SPDR = s->port[ i ];
+
+		while( !( SPSR & (1<<SPIF) ) )
+		{
+		}
+	}
+
+	// a rising edge of STCP copies the shift registers to the outputs
+	PORTB |= (1<<PB2);
+	PORTB &= ~(1<<PB2);
+}
+
+#endif
+
+
+#if PWM_ENGINE == PWM_ENGINE_STEP || PWM_ENGINE == PWM_ENGINE_EVENT
+
+// port values from a given step of the PWM cycle on
+typedef struct
+{
+	uint8_t step;
+	portState_t outputs;
+}
+pwmEvent_t;
+
+// Everything that happens within a single PWM cycle: The first entry (at step 0) switches on all
+// LEDs with a non-zero duty cycle, each of the following ones switches off one or more LEDs. The
+// last entry is followed by another one at step 0 which marks the end of the schedule. A constant
+// schedule consists of the first entry only, which holds until the next schedule is ready. With
+// PWM_STAGGER, the first entry holds the LEDs lit at step 0 and the following ones switch LEDs on
+// as well as off.
+typedef struct
+{
+	pwmEvent_t events[ ( PWM_STAGGER ? 2 : 1 ) * NUM_CHANNELS + 2 ];
+	uint8_t constant;
+}
+pwmSchedule_t;
+
+// double-buffered schedules: the interrupt handlers execute one while pwmUpdate() computes the
+// other (the index is volatile so it is read only after the ready flag has been cleared)
+static pwmSchedule_t g_schedules[ 2 ];
+static volatile uint8_t g_frontSchedule = 0;
+static volatile uint8_t g_backScheduleReady = 0;
+
+// the schedules grow with the square of the number of pixels (with the shift registers)
+_Static_assert( sizeof( g_schedules ) <= 512, "too many pixels for the schedules, use the BAM"
+                " (or no PWM_STAGGER)" );
+
+
+/**
+ * @brief Get the schedule for the PWM cycle that is about to begin
+ *
+ * This switches to a new schedule if one is ready. Must only be called at the beginning of a PWM
+ * cycle.
+ */
+static inline pwmSchedule_t const* beginSchedule( void )
+{
+	if( g_backScheduleReady )
+	{
+		g_frontSchedule ^= 1;
+		g_backScheduleReady = 0;
+	}
+
+#if PWM_DITHER_BITS > 0
+	g_pwmCycleStarted = 1;
+#endif
+
+	return &g_schedules[ g_frontSchedule ];
+}
+
+
+// whether the next PWM cycle has been compiled already
+static inline uint8_t pwmCompilePending( void )
+{
+	return g_backScheduleReady;
+}
+
+
+#if PWM_STAGGER
+
+// flag for the switch-on steps in pwmCompile() (the others are switch-off steps)
+#define SWITCH_ON 0x80
+
+// step of each channel at which its on-phase begins (see staggerInit())
+static uint8_t g_channelOffsets[ NUM_CHANNELS ];
+
+
+/**
+ * @brief Spread the switch-on steps of the channels evenly over the PWM cycle
+ *
+ * The steps are generated from the LED outputs: The channels are dealt out port by port, like
+ * cards (the first channel of each port, then the second one of each port, and so on), and each
+ * one gets the next of NUM_CHANNELS evenly spaced steps. So channels with adjacent steps are on
+ * different ports, and the channels of each port are spread over the whole PWM cycle as well.
+ */
+static void staggerInit( void )
+{
+	uint8_t n = 0;
+	uint8_t round;
+
+	for( round = 0; n < NUM_CHANNELS; round++ )
+	{
+		uint8_t port;
+
+		for( port = 0; port < NUM_LED_PORTS; port++ )
+		{
+			uint8_t rank = 0;
+			uint8_t i;
+
+			// the port's channel for this round (if it has that many)
+			for( i = 0; i < NUM_CHANNELS; i++ )
+			{
+				if( channelPort( i ) == port && rank++ == round )
+				{
+					g_channelOffsets[ i ] = (uint16_t) n * 256 / NUM_CHANNELS;
+					n += 1;
+					break;
+				}
+			}
+		}
+	}
+}
+
+
+/**
+ * @brief Compile the duty cycles for the next PWM cycle
+ *
+ * This compiles the duty cycles (in whole PWM steps, in the same order as g_channels) into a
+ * schedule. It is executed from the beginning of the next PWM cycle on. Each channel is lit from
+ * its offset (see g_channelOffsets) for the number of steps of its duty cycle, an on-phase that
+ * runs past the end of the PWM cycle continues at its beginning.
+ */
+static void pwmCompile( uint8_t const* duty )
+{
+	// Steps at which the channels are switched on or off (the channel, plus SWITCH_ON for
+	// switching on), sorted by step. Switching at step 0 is done by the first entry.
+	uint8_t switchStep[ 2 * NUM_CHANNELS ];
+	uint8_t switchChannel[ 2 * NUM_CHANNELS ];
+	uint8_t numSwitches = 0;
+
+	// channels that are neither off nor at maximum brightness
+	uint8_t numDimmed = 0;
+
+	// outputs at step 0, and of all lit channels (for a constant schedule)
+	portState_t outputs = g_idlePorts;
+	portState_t lit = g_idlePorts;
+	uint8_t i;
+
+	for( i = 0; i < NUM_CHANNELS; i++ )
+	{
+		uint8_t const d = duty[ i ];
+
+		if( d == 0 )
+		{
+			continue;
+		}
+
+		uint8_t const on = g_channelOffsets[ i ];
+		uint8_t const off = on + d;
+		uint8_t s;
+
+		lit.port[ channelPort( i ) ] |= channelMask( i );
+
+		if( d != 255 )
+		{
+			numDimmed += 1;
+		}
+
+		// lit at step 0 if the on-phase begins there or continues from the end of the PWM cycle
+		if( on == 0 || ( off != 0 && off < on ) )
+		{
+			outputs.port[ channelPort( i ) ] |= channelMask( i );
+		}
+
+		for( s = 0; s < 2; s++ )
+		{
+			uint8_t const step = s ? off : on;
+
+			if( step == 0 )
+			{
+				continue;
+			}
+
+			// insertion sort (there are only a few channels)
+			uint8_t j = numSwitches;
+			while( j > 0 && switchStep[ j - 1 ] > step )
+			{
+				switchStep[ j ] = switchStep[ j - 1 ];
+				switchChannel[ j ] = switchChannel[ j - 1 ];
+				j -= 1;
+			}
+			switchStep[ j ] = step;
+			switchChannel[ j ] = s ? i : i | SWITCH_ON;
+			numSwitches += 1;
+		}
+	}
+
+	// Drop the previous schedule if the interrupt handler has not picked it up yet. It does not
+	// switch schedules while the flag is cleared, so the back buffer can be overwritten safely.
+	g_backScheduleReady = 0;
+
+	pwmSchedule_t* schedule = &g_schedules[ g_frontSchedule ^ 1 ];
+	pwmEvent_t* event = schedule->events;
+
+	// Keep all lit LEDs switched on if the outputs can be constant.
+	schedule->constant = numDimmed == 0 && !isDithering();
+	if( schedule->constant )
+	{
+		outputs = lit;
+		numSwitches = 0;
+	}
+
+	event->step = 0;
+	event->outputs = outputs;
+	event += 1;
+
+	for( i = 0; i < numSwitches; i++ )
+	{
+		uint8_t const channel = switchChannel[ i ] & ~SWITCH_ON;
+
+		if( switchChannel[ i ] & SWITCH_ON )
+		{
+			outputs.port[ channelPort( channel ) ] |= channelMask( channel );
+		}
+		else
+		{
+			outputs.port[ channelPort( channel ) ] &= ~channelMask( channel );
+		}
+
+		// channels switched at the same step share an event
+		if( i + 1 == numSwitches || switchStep[ i + 1 ] != switchStep[ i ] )
+		{
+			event->step = switchStep[ i ];
+			event->outputs = outputs;
+			event += 1;
+		}
+	}
+
+	event->step = 0;
+
+	g_backScheduleReady = 1;
+}
+
+#else
+
+/**
+ * @brief Compile the duty cycles for the next PWM cycle
+ *
+ * This compiles the duty cycles (in whole PWM steps, in the same order as g_channels) into a
+ * schedule. It is executed from the beginning of the next PWM cycle on.
+ */
+static void pwmCompile( uint8_t const* duty )
+{
+	// channels with a non-zero duty cycle, sorted by duty cycle
+	uint8_t order[ NUM_CHANNELS ];
+	uint8_t numLit = 0;
+
+	// channels that are neither off nor at maximum brightness
+	uint8_t numDimmed = 0;
+
+	portState_t outputs = g_idlePorts;
+	uint8_t i;
+
+	for( i = 0; i < NUM_CHANNELS; i++ )
+	{
+		if( duty[ i ] == 0 )
+		{
+			continue;
+		}
+
+		outputs.port[ channelPort( i ) ] |= channelMask( i );
+
+		if( duty[ i ] != 255 )
+		{
+			numDimmed += 1;
+		}
+
+		// insertion sort (there are only a few channels)
+		uint8_t j = numLit;
+		while( j > 0 && duty[ order[ j - 1 ] ] > duty[ i ] )
+		{
+			order[ j ] = order[ j - 1 ];
+			j -= 1;
+		}
+		order[ j ] = i;
+		numLit += 1;
+	}
+
+	// Drop the previous schedule if the interrupt handler has not picked it up yet. It does not
+	// switch schedules while the flag is cleared, so the back buffer can be overwritten safely.
+	g_backScheduleReady = 0;
+
+	pwmSchedule_t* schedule = &g_schedules[ g_frontSchedule ^ 1 ];
+	pwmEvent_t* event = schedule->events;
+
+	event->step = 0;
+	event->outputs = outputs;
+	event += 1;
+
+	// Keep all lit LEDs switched on (instead of switching them off at step 255) if the outputs
+	// can be constant.
+	schedule->constant = numDimmed == 0 && !isDithering();
+	if( schedule->constant )
+	{
+		numLit = 0;
+	}
+
+	for( i = 0; i < numLit; i++ )
+	{
+		uint8_t channel = order[ i ];
+		outputs.port[ channelPort( channel ) ] &= ~channelMask( channel );
+
+		// channels with equal duty cycles are switched off by the same event
+		if( i + 1 == numLit || duty[ order[ i + 1 ] ] != duty[ channel ] )
+		{
+			event->step = duty[ channel ];
+			event->outputs = outputs;
+			event += 1;
+		}
+	}
+
+	event->step = 0;
+
+	g_backScheduleReady = 1;
+}
+
+#endif // PWM_STAGGER
+
+#endif
+
+
+#if PWM_ENGINE == PWM_ENGINE_STEP
+
+// clock select bits of the PWM timer (see pwmTimerInit())
+#define PWM_CLOCK_SELECT (1<<CS21)
+
+#if PWM_ASM
+
+#if PWM_OUTPUT != PWM_OUTPUT_PINS || TELEMETRY
+#error "the assembly PWM interrupt handler only supports the pins and no telemetry"
+#endif
+
+// the assembly interrupt handler loads the events as they are laid out here
+_Static_assert( sizeof( pwmEvent_t ) == 4 && LED_PORT_B == 0 && LED_PORT_C == 1 && LED_PORT_D == 2,
+                "pwmisr.S does not match pwmEvent_t" );
+
+// state of the assembly interrupt handler (see pwmisr.S)
+register uint8_t g_pwmStep asm( PWM_REG_NAME( PWM_REG_STEP ) );
+register uint8_t g_pwmNextStep asm( PWM_REG_NAME( PWM_REG_NEXT_STEP ) );
+register uint8_t g_pwmNextPortB asm( PWM_REG_NAME( PWM_REG_PORTB ) );
+register uint8_t g_pwmNextPortC asm( PWM_REG_NAME( PWM_REG_PORTC ) );
+register uint8_t g_pwmNextPortD asm( PWM_REG_NAME( PWM_REG_PORTD ) );
+register pwmEvent_t const* g_pwmNext asm( PWM_REG_NAME( PWM_REG_NEXT_LO ) );
+
+void pwmBeginCycle( void );
+
+
+// load an event as the next one into the registers of the interrupt handler
+static inline void loadEvent( pwmEvent_t const* event )
+{
+	g_pwmNextStep = event->step;
+	g_pwmNextPortB = event->outputs.port[ LED_PORT_B ];
+	g_pwmNextPortC = event->outputs.port[ LED_PORT_C ];
+	g_pwmNextPortD = event->outputs.port[ LED_PORT_D ];
+	g_pwmNext = event + 1;
+}
+
+
+/**
+ * @brief Beginning of a PWM cycle (called by the assembly interrupt handler)
+ *
+ * This does what the C version of the interrupt handler does at step 0.
+ */
+void pwmBeginCycle( void )
+{
+	pwmSchedule_t const* schedule = beginSchedule();
+	pwmEvent_t const* event = schedule->events;
+
+	setPorts( &event->outputs );
+
+	if( schedule->constant )
+	{
+		// Hold the outputs until the next schedule is ready. The step and the next event's step
+		// remain 0, so the next interrupt starts over.
+		pwmStop();
+		return;
+	}
+
+	loadEvent( event + 1 );
+	g_pwmStep = 1;
+}
+
+#else
+
+/**
+ * @brief Interrupt handler for a single PWM step
+ *
+ * This outputs the next entry of the schedule if its step has been reached.
+ */
+TELEMETRY_ISR( TIMER2_COMP_vect, TELEMETRY_ISR_PWM )
+{
+	static uint8_t pwmStep = 0;
+	static pwmEvent_t const* next = g_schedules[ 0 ].events;
+
+	if( pwmStep == next->step )
+	{
+		// Only the first entry and the end marker are at step 0, so the end marker is reached
+		// exactly at the beginning of the next PWM cycle.
+		if( pwmStep == 0 )
+		{
+			pwmSchedule_t const* schedule = beginSchedule();
+			next = schedule->events;
+
+			if( schedule->constant )
+			{
+				// Hold the outputs until the next schedule is ready. The step counter and next
+				// remain at the beginning of the PWM cycle, so the next interrupt starts over.
+				setPorts( &next->outputs );
+				pwmStop();
+				return;
+			}
+		}
+
+		setPorts( &next->outputs );
+		next += 1;
+	}
+
+	// Since it is an uint8, this counter overflows at 255. This is desired behaviour. It makes the
+	// counter run from 0 to 255, i.e. it makes a complete PWM cycle consist of 256 single steps.
+	pwmStep += 1;
+}
+
+#endif
+
+
+/**
+ * @Brief Set up timer that triggers an interrupt for every single PWM step
+ */
+static void pwmTimerInit( void )
+{
+	// prescaler for 8 bit timer: 1/8 clock frequency
+	TCCR2 |= PWM_CLOCK_SELECT;
+
+	// Clear Timer on Compare (CTC):
+	// reset counter TCNT2 when it reaches the value in OCR2
+	TCCR2 |= (1<<WGM21);
+
+	// frequency of timer interrupts: ca. 25.6 kHz
+	//
+	//    f = F_CPU / (PRESCALER * (1 + OCR2))
+	// OCR2 = F_CPU / (f * PRESCALER) - 1
+	//
+	// Since a complete PWM cycle consists of 256 single steps (see the PWM step counter in the
+	// associated interrupt handler) this leaves us with a PWM frequency of roughly
+	//
+	// f_PWM = 25.6 kHz / 256
+	//       = 100 Hz .
+	//
+	OCR2 = 38;
+
+#if PWM_ASM
+	// The registers are not initialized at reset. The first interrupt begins a PWM cycle.
+	g_pwmStep = 0;
+	g_pwmNextStep = 0;
+#endif
+
+	// enable interrupt on reaching the reference value in OCR2
+	TIMSK |= (1<<OCIE2);
+}
+
+#elif PWM_ENGINE == PWM_ENGINE_EVENT
+
+// clock select bits of the PWM timer (see pwmTimerInit())
+#define PWM_CLOCK_SELECT ( (1<<CS22) | (1<<CS21) )
+
+// next entry of the current schedule
+static pwmEvent_t const* g_nextEvent;
+
+
+/**
+ * @brief Interrupt handler for the beginning of a PWM cycle
+ *
+ * This switches on all LEDs with a non-zero duty cycle and sets the timer up to fire at the first
+ * switch-off event.
+ */
+TELEMETRY_ISR( TIMER2_OVF_vect, TELEMETRY_ISR_PWM )
+{
+	pwmSchedule_t const* schedule = beginSchedule();
+	pwmEvent_t const* event = schedule->events;
+
+	setPorts( &event->outputs );
+
+	if( schedule->constant )
+	{
+		// Hold the outputs until the next schedule is ready. The timer overflows again right
+		// after it has been restarted.
+		TIMSK &= ~(1<<OCIE2);
+		pwmStop();
+		TCNT2 = 0xff;
+		return;
+	}
+
+	event += 1;
+	g_nextEvent = event;
+
+	// discard compare matches with the previous schedule's last event
+	TIFR = (1<<OCF2);
+
+	if( event->step != 0 )
+	{
+		OCR2 = event->step;
+		TIMSK |= (1<<OCIE2);
+	}
+	else
+	{
+		TIMSK &= ~(1<<OCIE2);
+	}
+}
+
+
+/**
+ * @brief Interrupt handler for a switch-off event
+ */
+TELEMETRY_ISR( TIMER2_COMP_vect, TELEMETRY_ISR_PWM )
+{
+	pwmEvent_t const* event = g_nextEvent;
+
+	setPorts( &event->outputs );
+
+	event += 1;
+	g_nextEvent = event;
+
+	if( event->step != 0 )
+	{
+		OCR2 = event->step;
+	}
+}
+
+
+/**
+ * @Brief Set up a free-running timer with one tick per PWM step
+ */
+static void pwmTimerInit( void )
+{
+	// prescaler for 8 bit timer: 1/256 clock frequency
+	//
+	// The timer runs through all of its 256 values in a single PWM cycle (normal mode), so the PWM
+	// frequency is
+	//
+	// f_PWM = F_CPU / (PRESCALER * 256)
+	//       = ca. 122 Hz .
+	//
+	TCCR2 |= PWM_CLOCK_SELECT;
+
+	// enable interrupt on timer overflow (the switch-off interrupt is enabled as required)
+	TIMSK |= (1<<TOIE2);
+}
+
+#elif PWM_ENGINE == PWM_ENGINE_BAM
+
+// Timer clock for bit angle modulation. A single timer tick is the duration of the shortest bit
+// period, so the PWM frequency is
+//
+// f_PWM = F_CPU / (PRESCALER * 255)
+//
+// i.e. ca. 122.5 Hz for 1/256 clock frequency. Using 1/64 clock frequency (1<<CS22) instead yields
+// ca. 490 Hz, but then the interrupt handler has to finish within 64 CPU cycles.
+#ifndef PWM_BAM_CLOCK_SELECT
+#define PWM_BAM_CLOCK_SELECT ( (1<<CS22) | (1<<CS21) )
+#endif
+
+#define PWM_CLOCK_SELECT PWM_BAM_CLOCK_SELECT
+
+// double-buffered bit planes (port values for each bit of the duty cycles): the interrupt handler
+// displays one set while pwmUpdate() computes the other (the index is volatile so it is read only
+// after the ready flag has been cleared)
+static portState_t g_bitPlanes[ 2 ][ 8 ];
+static volatile uint8_t g_frontPlanes = 0;
+static volatile uint8_t g_backPlanesReady = 0;
+
+// flags for bit planes which are all the same (all LEDs either off or at maximum brightness)
+static uint8_t g_constantPlanes[ 2 ];
+
+
+/**
+ * @brief Interrupt handler for a single bit period
+ *
+ * This outputs the precomputed bit plane and sets the timer up to hold it for the time weighted by
+ * the plane's bit.
+ */
+TELEMETRY_ISR( TIMER2_COMP_vect, TELEMETRY_ISR_PWM )
+{
+	static uint8_t bit = 0;
+	static portState_t const* plane = g_bitPlanes[ 0 ];
+
+	if( bit == 0 )
+	{
+		// switch to new bit planes only at the beginning of a PWM cycle
+		if( g_backPlanesReady )
+		{
+			g_frontPlanes ^= 1;
+			g_backPlanesReady = 0;
+		}
+
+#if PWM_DITHER_BITS > 0
+		g_pwmCycleStarted = 1;
+#endif
+
+		plane = g_bitPlanes[ g_frontPlanes ];
+
+		if( g_constantPlanes[ g_frontPlanes ] )
+		{
+			// Hold the outputs until the next bit planes are ready. The bit period remains at the
+			// beginning of the PWM cycle with a duration of a single timer tick, so the next
+			// interrupt starts over right after the timer has been restarted.
+			setPorts( plane );
+			OCR2 = 0;
+			TCNT2 = 0;
+			pwmStop();
+			return;
+		}
+	}
+
+	// The counter has just been reset, so this sets the duration of the period that has just
+	// started: 2^bit timer ticks. This comes first, as the outputs may take a while (see
+	// setPorts()).
+	OCR2 = ( 1 << bit ) - 1;
+
+	setPorts( plane );
+
+	plane += 1;
+	bit = ( bit + 1 ) & 7;
+}
+
+
+/**
+ * @Brief Set up timer that triggers an interrupt at the beginning of each bit period
+ */
+static void pwmTimerInit( void )
+{
+	TCCR2 |= PWM_CLOCK_SELECT;
+
+	// Clear Timer on Compare (CTC):
+	// reset counter TCNT2 when it reaches the value in OCR2
+	TCCR2 |= (1<<WGM21);
+
+	OCR2 = 0;
+
+	// enable interrupt on reaching the reference value in OCR2
+	TIMSK |= (1<<OCIE2);
+}
+
+
+// whether the next PWM cycle has been compiled already
+static inline uint8_t pwmCompilePending( void )
+{
+	return g_backPlanesReady;
+}
+
+
+/**
+ * @brief Compile the duty cycles for the next PWM cycle
+ *
+ * This computes the bit planes from the duty cycles (in whole PWM steps, in the same order as
+ * g_channels). They are displayed from the beginning of the next PWM cycle on.
+ */
+static void pwmCompile( uint8_t const* duty )
+{
+	// Drop the previous bit planes if the interrupt handler has not picked them up yet. It does not
+	// switch bit planes while the flag is cleared, so the back buffer can be overwritten safely.
+	g_backPlanesReady = 0;
+
+	portState_t* planes = g_bitPlanes[ g_frontPlanes ^ 1 ];
+	uint8_t constant = !isDithering();
+	uint8_t i;
+	uint8_t bit;
+
+	for( bit = 0; bit < 8; bit++ )
+	{
+		planes[ bit ] = g_idlePorts;
+	}
+
+	for( i = 0; i < NUM_CHANNELS; i++ )
+	{
+		uint8_t d = duty[ i ];
+
+		if( d != 0 && d != 255 )
+		{
+			constant = 0;
+		}
+
+		for( bit = 0; d != 0; bit++, d >>= 1 )
+		{
+			if( d & 1 )
+			{
+				planes[ bit ].port[ channelPort( i ) ] |= channelMask( i );
+			}
+		}
+	}
+
+	g_constantPlanes[ g_frontPlanes ^ 1 ] = constant;
+	g_backPlanesReady = 1;
+}
+
+#else
+#error "Unknown PWM_ENGINE"
+#endif
+
+
+/**
+ * @brief Restart the PWM timer if it has been stopped
+ *
+ * Must be called after a new PWM cycle has been compiled. The interrupt handler then starts with
+ * the new PWM cycle (and stops the timer again if its outputs are constant).
+ */
+static inline void pwmResume( void )
+{
+	if( g_pwmStopped )
+	{
+		g_pwmStopped = 0;
+		TCCR2 |= PWM_CLOCK_SELECT;
+	}
+}
+
+
+#if PWM_DITHER_BITS > 0
+
+/**
+ * @brief Compile the next PWM cycle of the dithered duty cycles
+ *
+ * The fractional part of each duty cycle is added to the channel's accumulated error. If that adds
+ * up to a whole step, the channel is lit one step longer in the next PWM cycle and the step is
+ * subtracted from the error.
+ */
+static void ditherStep( void )
+{
+	uint8_t duty[ NUM_CHANNELS ];
+	uint8_t i;
+
+	for( i = 0; i < NUM_CHANNELS; i++ )
+	{
+		uint16_t error = g_ditherError[ i ] + ( g_duty[ i ] & DITHER_MASK );
+
+		duty[ i ] = ( g_duty[ i ] >> PWM_DITHER_BITS ) + ( error >> PWM_DITHER_BITS );
+		g_ditherError[ i ] = error & DITHER_MASK;
+	}
+
+	pwmCompile( duty );
+}
+
+#endif
+
+
+/**
+ * @brief Make the current duty cycles visible
+ *
+ * This compiles the duty cycles (in PWM steps, with PWM_DITHER_BITS fractional bits) of all pixels.
+ * They are displayed from the beginning of the next PWM cycle on. Duty cycles above PWM_MAX_DUTY
+ * are displayed as PWM_MAX_DUTY.
+ */
+void pwmUpdate( ledDuty_t const* pixelDuty )
+{
+	// flat view of the duty cycles (in the same order as g_channels)
+	pwmDuty_t const* duty = &pixelDuty[ 0 ].r;
+
+#if PWM_DITHER_BITS > 0
+	uint8_t fraction = 0;
+	uint8_t i;
+
+	for( i = 0; i < NUM_CHANNELS; i++ )
+	{
+		pwmDuty_t d = duty[ i ] <= PWM_MAX_DUTY ? duty[ i ] : PWM_MAX_DUTY;
+
+		g_duty[ i ] = d;
+		fraction |= d & DITHER_MASK;
+	}
+
+	g_dithering = fraction != 0;
+
+	ditherStep();
+#else
+	pwmCompile( duty );
+#endif
+
+	pwmResume();
+}
+
+
+/**
+ * @brief Compile the next PWM cycle if the duty cycles are dithered
+ *
+ * This has to be called from the main loop at least once per PWM cycle. It returns immediately if
+ * there is nothing to do: if the current PWM cycle has already been compiled, if the next one has
+ * been compiled by pwmUpdate() already or if no duty cycle has a fractional part.
+ */
+void pwmDither( void )
+{
+#if PWM_DITHER_BITS > 0
+	if( !g_pwmCycleStarted )
+	{
+		return;
+	}
+
+	g_pwmCycleStarted = 0;
+
+	if( g_dithering && !pwmCompilePending() )
+	{
+		ditherStep();
+	}
+#endif
+}
+
+
+/**
+ * @brief Whether pwmDither() has to compile the next PWM cycle
+ *
+ * The main loop must not sleep in this case (see pwmDither()).
+ */
+uint8_t pwmDitherPending( void )
+{
+#if PWM_DITHER_BITS > 0
+	return g_pwmCycleStarted && g_dithering;
+#else
+	return 0;
+#endif
+}
+
+
+/**
+ * @brief Whether the PWM timer has been stopped because the outputs are constant
+ */
+uint8_t pwmStopped( void )
+{
+	return g_pwmStopped;
+}
+
+
+/**
+ * @brief Configure the LED outputs and start the PWM
+ */
+void pwmInit( void )
+{
+	ledDuty_t off[ NUM_PIXELS ] = { { 0 } };
+
+#if PWM_OUTPUT == PWM_OUTPUT_PINS
+	portState_t ledPins = { { 0 } };
+	uint8_t i;
+
+	for( i = 0; i < NUM_CHANNELS; i++ )
+	{
+		ledPins.port[ channelPort( i ) ] |= channelMask( i );
+	}
+
+	// configure LED pins as outputs, disable by default
+	DDRB |= ledPins.port[ LED_PORT_B ];
+	DDRC |= ledPins.port[ LED_PORT_C ];
+	DDRD |= ledPins.port[ LED_PORT_D ];
+
+	g_idlePorts.port[ LED_PORT_B ] = PORTB & ~ledPins.port[ LED_PORT_B ];
+	g_idlePorts.port[ LED_PORT_C ] = PORTC & ~ledPins.port[ LED_PORT_C ];
+	g_idlePorts.port[ LED_PORT_D ] = PORTD & ~ledPins.port[ LED_PORT_D ];
+#else
+	// SPI master at half the CPU clock, MSB (Q7) first, SS (PB2) as output for latching (the shift
+	// registers only drive LEDs, so g_idlePorts are all 0)
+	DDRB |= (1<<PB2) | (1<<PB3) | (1<<PB5);
+	SPCR = (1<<SPE) | (1<<MSTR);
+	SPSR = (1<<SPI2X);
+#endif
+
+	setPorts( &g_idlePorts );
+
+#if PWM_STAGGER
+	staggerInit();
+#endif
+
+	// initially switch all pixels off
+	pwmUpdate( off );
+	pwmTimerInit();
+}
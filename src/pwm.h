@@ -0,0 +1,92 @@
+#ifndef PWM_H_
+#define PWM_H_
+
+#include "ledterne.h"
+
+#include <inttypes.h>
+
+
+// Available PWM engines. Select one by defining PWM_ENGINE (see the Makefile).
+#define PWM_ENGINE_STEP 0 // one timer interrupt for each of the 256 steps of a PWM cycle
+#define PWM_ENGINE_BAM  1 // bit angle modulation: one timer interrupt per bit of the duty cycle
+#define PWM_ENGINE_EVENT 2 // one timer interrupt for each point in time where an output changes
+
+#ifndef PWM_ENGINE
+#define PWM_ENGINE PWM_ENGINE_STEP
+#endif
+
+// Available output backends. Select one by defining PWM_OUTPUT (see the Makefile).
+#define PWM_OUTPUT_PINS  0 // each LED on a pin of the ATmega8 (5 pixels)
+#define PWM_OUTPUT_SHIFT 1 // LEDs on a chain of 74HC595 shift registers, loaded over the SPI
+
+#ifndef PWM_OUTPUT
+#define PWM_OUTPUT PWM_OUTPUT_PINS
+#endif
+
+#if PWM_OUTPUT == PWM_OUTPUT_PINS && NUM_PIXELS != 5
+#error "the pins of the ATmega8 drive 5 pixels, use PWM_OUTPUT_SHIFT for others"
+#endif
+
+// 1: use the interrupt handler of PWM_ENGINE_STEP written in assembly (see pwmisr.S), which keeps
+// its state in reserved registers (see pwmregs.h). Only with PWM_OUTPUT_PINS and without telemetry.
+#ifndef PWM_ASM
+#define PWM_ASM 0
+#endif
+
+// 1: spread the switch-on steps of the channels over the PWM cycle instead of switching all of them
+// on at step 0, so fewer LEDs are lit at the same time (lower peak current, see pwm.c). Only with
+// PWM_ENGINE_STEP and PWM_ENGINE_EVENT.
+#ifndef PWM_STAGGER
+#define PWM_STAGGER 0
+#endif
+
+#if PWM_STAGGER && PWM_ENGINE == PWM_ENGINE_BAM
+#error "PWM_STAGGER needs PWM_ENGINE_STEP or PWM_ENGINE_EVENT"
+#endif
+
+// Number of fractional bits of the duty cycles. The PWM can only output whole steps, so a duty cycle
+// with a fractional part is approximated by alternating between the two adjacent whole steps in
+// successive PWM cycles (see pwmDither()). 0 disables dithering.
+#ifndef PWM_DITHER_BITS
+#define PWM_DITHER_BITS 4
+#endif
+
+#if PWM_DITHER_BITS < 0 || PWM_DITHER_BITS > 8
+#error "PWM_DITHER_BITS must be 0 - 8"
+#endif
+
+
+typedef struct
+{
+	uint8_t r;
+	uint8_t g;
+	uint8_t b;
+}
+ledIntensity_t;
+
+// duty cycle in PWM steps, with PWM_DITHER_BITS fractional bits
+#if PWM_DITHER_BITS > 0
+typedef uint16_t pwmDuty_t;
+#else
+typedef uint8_t pwmDuty_t;
+#endif
+
+// maximum duty cycle (255 whole PWM steps)
+#define PWM_MAX_DUTY ( (pwmDuty_t) 255 << PWM_DITHER_BITS )
+
+typedef struct
+{
+	pwmDuty_t r;
+	pwmDuty_t g;
+	pwmDuty_t b;
+}
+ledDuty_t;
+
+void pwmInit( void );
+void pwmUpdate( ledDuty_t const* pixelDuty );
+void pwmDither( void );
+uint8_t pwmDitherPending( void );
+uint8_t pwmStopped( void );
+
+
+#endif // PWM_H_
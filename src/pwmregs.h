@@ -0,0 +1,21 @@
+#ifndef PWMREGS_H_
+#define PWMREGS_H_
+
+// Registers reserved for the assembly PWM interrupt handler (see pwmisr.S and PWM_ASM in pwm.h).
+// The C code must not use them, so it is compiled with -ffixed-<register> for each of them (see
+// the Makefile, which has to be changed along with this list).
+#define PWM_REG_STEP      r2 // current PWM step
+#define PWM_REG_NEXT_STEP r3 // step of the next event of the schedule
+#define PWM_REG_PORTB     r4 // outputs of the next event
+#define PWM_REG_PORTC     r5
+#define PWM_REG_PORTD     r6
+#define PWM_REG_SREG      r7 // SREG of the interrupted code
+#define PWM_REG_NEXT_LO   r8 // address of the event behind the next one (low byte of a pair)
+#define PWM_REG_NEXT_HI   r9
+
+// register name as a string (for the C code's global register variables)
+#define PWM_REG_NAME_( reg ) #reg
+#define PWM_REG_NAME( reg ) PWM_REG_NAME_( reg )
+
+
+#endif // PWMREGS_H_
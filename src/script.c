@@ -0,0 +1,262 @@
+#include "script.h"
+#include "animations.h"
+#include "ledterne.h"
+
+#include <avr/pgmspace.h>
+#include <string.h>
+
+
+// number of bytes of each instruction (opcode and arguments)
+static uint8_t const g_instructionSize[] PROGMEM =
+{
+	[ SCRIPT_OP_SET ]    = 5,
+	[ SCRIPT_OP_FADE ]   = 6,
+	[ SCRIPT_OP_RAMP ]   = 5,
+	[ SCRIPT_OP_LEVELS ] = 2, // plus the levels
+	[ SCRIPT_OP_DIM ]    = 2,
+	[ SCRIPT_OP_SHIFT ]  = 2,
+	[ SCRIPT_OP_WAIT ]   = 2,
+	[ SCRIPT_OP_REPEAT ] = 2,
+	[ SCRIPT_OP_LOOP ]   = 1,
+	[ SCRIPT_OP_END ]    = 1,
+};
+
+
+void Script_init( ScriptProgram* prog, uint8_t const* script )
+{
+	memset( prog, 0, sizeof( *prog ) );
+	prog->script = script;
+	prog->pc     = script;
+}
+
+
+// advance one color channel of a ramp by one step
+static void rampStep( uint8_t* value, int8_t* ramp )
+{
+	if( *ramp != 0 )
+	{
+		uint8_t stepSize = *ramp > 0 ? *ramp : -*ramp;
+		RampUpDownAnimation ani = { MAX_INTENSITY, *ramp > 0 };
+
+		RampUpDown_step( &ani, value, stepSize );
+		*ramp = ani.up ? stepSize : -stepSize;
+	}
+}
+
+
+// next lower intensity level (or 0)
+static uint8_t dim( ScriptProgram const* prog, uint8_t value )
+{
+	uint8_t i = prog->numLevels;
+
+	while( i-- > 0 )
+	{
+		uint8_t level = pgm_read_byte( &prog->levels[ i ] );
+		if( level < value )
+		{
+			return level;
+		}
+	}
+
+	return 0;
+}
+
+
+// rotate the pixels by one (up: pixel 0 moves to pixel 1, the last one to pixel 0)
+static void shift( ScriptProgram* prog, uint8_t up )
+{
+	uint8_t color[ 3 ];
+	int8_t ramp[ 3 ];
+
+	if( up )
+	{
+		memcpy( color, prog->color[ NUM_PIXELS - 1 ], 3 );
+		memcpy( ramp, prog->ramp[ NUM_PIXELS - 1 ], 3 );
+		memmove( prog->color[ 1 ], prog->color[ 0 ], 3 * ( NUM_PIXELS - 1 ) );
+		memmove( prog->ramp[ 1 ], prog->ramp[ 0 ], 3 * ( NUM_PIXELS - 1 ) );
+		memcpy( prog->color[ 0 ], color, 3 );
+		memcpy( prog->ramp[ 0 ], ramp, 3 );
+	}
+	else
+	{
+		memcpy( color, prog->color[ 0 ], 3 );
+		memcpy( ramp, prog->ramp[ 0 ], 3 );
+		memmove( prog->color[ 0 ], prog->color[ 1 ], 3 * ( NUM_PIXELS - 1 ) );
+		memmove( prog->ramp[ 0 ], prog->ramp[ 1 ], 3 * ( NUM_PIXELS - 1 ) );
+		memcpy( prog->color[ NUM_PIXELS - 1 ], color, 3 );
+		memcpy( prog->ramp[ NUM_PIXELS - 1 ], ramp, 3 );
+	}
+}
+
+
+// Execute the instructions up to the next one that shows a frame (S_WAIT() or S_FADE()), return 1
+// if an S_END() has been passed.
+static uint8_t run( ScriptProgram* prog )
+{
+	uint8_t finished = 0;
+
+	while( 1 )
+	{
+		uint8_t const* pc = prog->pc;
+		uint8_t op = pgm_read_byte( &pc[ 0 ] );
+		uint8_t arg = pgm_read_byte( &pc[ 1 ] );
+		uint8_t mask = arg;
+		uint8_t i, c;
+
+		switch( op )
+		{
+			case SCRIPT_OP_SET:
+			case SCRIPT_OP_RAMP:
+				for( i = 0; i < NUM_PIXELS; i++, mask >>= 1 )
+				{
+					if( mask & 1 )
+					{
+						for( c = 0; c < 3; c++ )
+						{
+							uint8_t v = pgm_read_byte( &pc[ 2 + c ] );
+
+							if( op == SCRIPT_OP_SET )
+							{
+								prog->color[ i ][ c ] = v;
+							}
+							else
+							{
+								prog->ramp[ i ][ c ] = v;
+							}
+						}
+					}
+				}
+				break;
+
+			case SCRIPT_OP_LEVELS:
+				prog->numLevels = arg;
+				prog->levels = &pc[ 2 ];
+				prog->pc += arg;
+				break;
+
+			case SCRIPT_OP_DIM:
+				for( i = 0; i < NUM_PIXELS; i++, mask >>= 1 )
+				{
+					if( mask & 1 )
+					{
+						for( c = 0; c < 3; c++ )
+						{
+							prog->color[ i ][ c ] = dim( prog, prog->color[ i ][ c ] );
+						}
+					}
+				}
+				break;
+
+			case SCRIPT_OP_SHIFT:
+				shift( prog, arg );
+				break;
+
+			case SCRIPT_OP_REPEAT:
+				prog->loopStart[ prog->depth ] = &pc[ 2 ];
+				prog->loopCount[ prog->depth ] = arg;
+				prog->depth += 1;
+				break;
+
+			case SCRIPT_OP_LOOP:
+			{
+				uint8_t* count = &prog->loopCount[ prog->depth - 1 ];
+
+				// a count of 0 repeats forever
+				if( *count == 0 || --*count > 0 )
+				{
+					prog->pc = prog->loopStart[ prog->depth - 1 ];
+					continue;
+				}
+
+				prog->depth -= 1;
+				break;
+			}
+
+			case SCRIPT_OP_END:
+				finished = 1;
+				break;
+
+			default:
+				// S_WAIT() and S_FADE()
+				return finished;
+		}
+
+		prog->pc += pgm_read_byte( &g_instructionSize[ op ] );
+	}
+}
+
+
+uint8_t Script_execute( ScriptProgram* prog )
+{
+	uint8_t i, c;
+
+	// the first call executes the setup in front of the first frame
+	run( prog );
+
+	uint8_t const* pc = prog->pc;
+	uint8_t op = pgm_read_byte( &pc[ 0 ] );
+	uint8_t arg = pgm_read_byte( &pc[ 1 ] );
+
+	if( op == SCRIPT_OP_WAIT )
+	{
+		if( prog->wait == 0 )
+		{
+			prog->wait = arg;
+		}
+
+		prog->wait -= 1;
+		if( prog->wait == 0 )
+		{
+			prog->pc += 2;
+		}
+	}
+	else // SCRIPT_OP_FADE
+	{
+		uint8_t mask = arg;
+		uint8_t step = pgm_read_byte( &pc[ 5 ] );
+		uint8_t reached = 1;
+
+		for( i = 0; i < NUM_PIXELS; i++, mask >>= 1 )
+		{
+			if( mask & 1 )
+			{
+				for( c = 0; c < 3; c++ )
+				{
+					uint8_t* v = &prog->color[ i ][ c ];
+					uint8_t target = pgm_read_byte( &pc[ 2 + c ] );
+
+					if( *v < target )
+					{
+						*v = target - *v > step ? *v + step : target;
+					}
+					else if( *v > target )
+					{
+						*v = *v - target > step ? *v - step : target;
+					}
+
+					reached &= *v == target;
+				}
+			}
+		}
+
+		if( reached )
+		{
+			prog->pc += 6;
+		}
+	}
+
+	// draw the frame, then advance the ramps
+	for( i = 0; i < NUM_PIXELS; i++ )
+	{
+		setPixel( i, prog->color[ i ][ 0 ], prog->color[ i ][ 1 ], prog->color[ i ][ 2 ] );
+
+		for( c = 0; c < 3; c++ )
+		{
+			rampStep( &prog->color[ i ][ c ], &prog->ramp[ i ][ c ] );
+		}
+	}
+
+	// execute the instructions between this frame and the next one right away, so that an S_END()
+	// directly behind this frame finishes the program with this frame
+	return run( prog );
+}
@@ -0,0 +1,107 @@
+#ifndef SCRIPT_H_
+#define SCRIPT_H_
+
+/**
+ * Keyframe scripts: data-driven animations
+ *
+ * A script is a byte code program in flash which is interpreted by a tiny virtual machine, so a new
+ * animation only needs a new script (see scripts.c) and an entry in the animation's module list,
+ * but no new C code. The machine holds a color and a ramp velocity for each pixel. Instructions:
+ *
+ *     S_SET( mask, r, g, b )       set the color of the pixels in mask
+ *     S_FADE( mask, r, g, b, s )   fade the pixels in mask towards the color by s per frame, one
+ *                                  frame after the other until the color is reached
+ *     S_RAMP( mask, r, g, b )      let the color channels of the pixels in mask ramp up and down
+ *                                  between 0 and MAX_INTENSITY by the given (signed) steps per
+ *                                  frame, 0 stops the channel (see RampUpDown_step())
+ *     S_LEVELS( n ), l0, ...       intensity levels for S_DIM() (n levels, ascending)
+ *     S_DIM( mask )                dim all color channels of the pixels in mask to the next lower
+ *                                  level (or 0)
+ *     S_SHIFT_UP(), S_SHIFT_DOWN() rotate the colors (and ramps) by one pixel
+ *     S_WAIT( n )                  show n frames (1 - 255)
+ *     S_REPEAT( n ) ... S_LOOP()   repeat the instructions n times (0: forever), up to
+ *                                  SCRIPT_MAX_NESTING deep
+ *     S_END()                      the last frame finished a run of the program (Script_execute()
+ *                                  returns 1, the script simply continues)
+ *
+ * Only S_WAIT() and S_FADE() show frames. Each frame is drawn from the current colors, then the
+ * ramps advance by one step. Everything else executes between two frames, right after the
+ * previous one, so an S_END() directly behind a frame marks that frame.
+ *
+ * A script that should run forever has to be wrapped in S_REPEAT( 0 ) ... S_LOOP(). Instructions
+ * in front of it are executed only once (for setting up the colors, ramps and levels). Each loop
+ * needs to show at least one frame.
+ */
+
+#include "ledterne.h"
+
+#include <inttypes.h>
+
+
+// maximum nesting depth of S_REPEAT()
+#define SCRIPT_MAX_NESTING 2
+
+
+enum ScriptOpcode
+{
+	SCRIPT_OP_SET,
+	SCRIPT_OP_FADE,
+	SCRIPT_OP_RAMP,
+	SCRIPT_OP_LEVELS,
+	SCRIPT_OP_DIM,
+	SCRIPT_OP_SHIFT,
+	SCRIPT_OP_WAIT,
+	SCRIPT_OP_REPEAT,
+	SCRIPT_OP_LOOP,
+	SCRIPT_OP_END
+};
+
+// pixel masks (8 bit, so instructions with a mask only address the first 8 pixels)
+#define PIXEL( i ) ( 1 << ( i ) )
+#if NUM_PIXELS < 8
+#define ALL_PIXELS ( ( 1 << NUM_PIXELS ) - 1 )
+#else
+#define ALL_PIXELS 0xff
+#endif
+
+// instructions
+#define S_SET( mask, r, g, b )        SCRIPT_OP_SET, ( mask ), ( r ), ( g ), ( b )
+#define S_FADE( mask, r, g, b, step ) SCRIPT_OP_FADE, ( mask ), ( r ), ( g ), ( b ), ( step )
+#define S_RAMP( mask, r, g, b )       SCRIPT_OP_RAMP, ( mask ), (uint8_t) ( r ), (uint8_t) ( g ), (uint8_t) ( b )
+#define S_LEVELS( n )                 SCRIPT_OP_LEVELS, ( n )
+#define S_DIM( mask )                 SCRIPT_OP_DIM, ( mask )
+#define S_SHIFT_UP()                  SCRIPT_OP_SHIFT, 1
+#define S_SHIFT_DOWN()                SCRIPT_OP_SHIFT, 0
+#define S_WAIT( n )                   SCRIPT_OP_WAIT, ( n )
+#define S_REPEAT( n )                 SCRIPT_OP_REPEAT, ( n )
+#define S_LOOP()                      SCRIPT_OP_LOOP
+#define S_END()                       SCRIPT_OP_END
+
+
+typedef struct _ScriptProgram
+{
+	uint8_t const* script; // in flash
+	uint8_t const* pc;     // next instruction
+	uint8_t const* levels; // intensity levels for S_DIM()
+	uint8_t numLevels;
+	uint8_t wait;          // remaining frames of the current S_WAIT()
+	uint8_t depth;         // number of active S_REPEAT()s
+	uint8_t const* loopStart[ SCRIPT_MAX_NESTING ];
+	uint8_t loopCount[ SCRIPT_MAX_NESTING ];
+	uint8_t color[ NUM_PIXELS ][ 3 ];
+	int8_t ramp[ NUM_PIXELS ][ 3 ];
+}
+ScriptProgram;
+
+void Script_init( ScriptProgram* prog, uint8_t const* script );
+uint8_t Script_execute( ScriptProgram* prog );
+
+
+// the original programs as scripts (see scripts.c)
+extern uint8_t const g_scriptMixedColorBlending[];
+extern uint8_t const g_scriptKnightRider[];
+extern uint8_t const g_scriptColoredConveyor[];
+extern uint8_t const g_scriptTestDisplays[];
+
+
+#endif // SCRIPT_H_
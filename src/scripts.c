@@ -0,0 +1,116 @@
+/**
+ * Animation scripts (see script.h)
+ *
+ * These are the programs from animations.c written as scripts. They draw exactly the same frames as
+ * the native versions (which is checked by the host harness, see host/), for 5 pixels: the pixel
+ * indices and phases are written out, so other numbers of pixels need scripts of their own.
+ */
+
+#include "script.h"
+#include "ledterne.h"
+
+#include <avr/pgmspace.h>
+
+
+// all pixels show the same color, each color channel ramps up and down at a different speed
+uint8_t const g_scriptMixedColorBlending[] PROGMEM =
+{
+	S_SET( ALL_PIXELS, 0, 10, 21 ),
+	S_RAMP( ALL_PIXELS, 2, 1, 3 ),
+
+	S_REPEAT( 0 ),
+		// arbitrary program length, the colors only repeat much later
+		S_WAIT( 100 ),
+		S_END(),
+	S_LOOP(),
+};
+
+
+// see KnightRider_execute()
+#define KNIGHT_RIDER_FRAME( centerIndex ) \
+	S_DIM( ALL_PIXELS ), S_SET( PIXEL( centerIndex ), MAX_INTENSITY, 0, 0 ), S_WAIT( 1 )
+
+uint8_t const g_scriptKnightRider[] PROGMEM =
+{
+	// fade states of the pixels behind the center pixel (0.162, 0.710 and 1.000 of MAX_INTENSITY)
+	S_LEVELS( 3 ), 5, 22, MAX_INTENSITY,
+
+	S_REPEAT( 0 ),
+		// bounce twice
+		S_REPEAT( 2 ),
+			KNIGHT_RIDER_FRAME( 0 ),
+			KNIGHT_RIDER_FRAME( 1 ),
+			KNIGHT_RIDER_FRAME( 2 ),
+			KNIGHT_RIDER_FRAME( 3 ),
+			KNIGHT_RIDER_FRAME( 4 ),
+			KNIGHT_RIDER_FRAME( 3 ),
+			KNIGHT_RIDER_FRAME( 2 ),
+			KNIGHT_RIDER_FRAME( 1 ),
+		S_LOOP(),
+		KNIGHT_RIDER_FRAME( 0 ),
+
+		// pause
+		S_REPEAT( 9 ),
+			S_DIM( ALL_PIXELS ),
+			S_WAIT( 1 ),
+		S_LOOP(),
+		S_END(),
+	S_LOOP(),
+};
+
+
+// Four triangle cycles (4 * 62 frames) of one color, then the pixels switch to the next one, one
+// after the other when they reach zero intensity (in order of their phase). A pixel switches by
+// starting to ramp up the next color right after the frame in which it has reached zero.
+#define COLORED_CONVEYOR_COLOR( r, g, b )                                   \
+	S_WAIT( 62 ), S_END(),                                                  \
+	S_WAIT( 62 ), S_END(),                                                  \
+	S_WAIT( 62 ), S_END(),                                                  \
+	S_WAIT(  1 ), S_SET( PIXEL( 0 ), r, g, b ), S_RAMP( PIXEL( 0 ), r, g, b ), \
+	S_WAIT( 12 ), S_SET( PIXEL( 4 ), r, g, b ), S_RAMP( PIXEL( 4 ), r, g, b ), \
+	S_WAIT( 12 ), S_SET( PIXEL( 3 ), r, g, b ), S_RAMP( PIXEL( 3 ), r, g, b ), \
+	S_WAIT( 13 ), S_SET( PIXEL( 2 ), r, g, b ), S_RAMP( PIXEL( 2 ), r, g, b ), \
+	S_WAIT( 12 ), S_SET( PIXEL( 1 ), r, g, b ), S_RAMP( PIXEL( 1 ), r, g, b ), \
+	S_WAIT( 12 ), S_END()
+
+uint8_t const g_scriptColoredConveyor[] PROGMEM =
+{
+	// the pixels are distributed evenly over the triangle wave (see ColoredConveyor_execute())
+	S_SET( PIXEL( 0 ),  0, 0, 0 ), S_RAMP( PIXEL( 0 ),  1, 0, 0 ),
+	S_SET( PIXEL( 1 ), 13, 0, 0 ), S_RAMP( PIXEL( 1 ),  1, 0, 0 ),
+	S_SET( PIXEL( 2 ), 25, 0, 0 ), S_RAMP( PIXEL( 2 ),  1, 0, 0 ),
+	S_SET( PIXEL( 3 ), 24, 0, 0 ), S_RAMP( PIXEL( 3 ), -1, 0, 0 ),
+	S_SET( PIXEL( 4 ), 12, 0, 0 ), S_RAMP( PIXEL( 4 ), -1, 0, 0 ),
+
+	S_REPEAT( 0 ),
+		COLORED_CONVEYOR_COLOR( 0, 1, 0 ),
+		COLORED_CONVEYOR_COLOR( 0, 0, 1 ),
+		COLORED_CONVEYOR_COLOR( 1, 0, 0 ),
+	S_LOOP(),
+};
+
+
+// light up one pixel after the other, first in red, then in green and blue
+uint8_t const g_scriptTestDisplays[] PROGMEM =
+{
+	S_REPEAT( 0 ),
+		S_SET( PIXEL( 0 ), MAX_INTENSITY, 0, 0 ),
+		S_REPEAT( NUM_PIXELS ),
+			S_WAIT( 1 ),
+			S_SHIFT_UP(),
+		S_LOOP(),
+
+		S_SET( PIXEL( 0 ), 0, MAX_INTENSITY, 0 ),
+		S_REPEAT( NUM_PIXELS ),
+			S_WAIT( 1 ),
+			S_SHIFT_UP(),
+		S_LOOP(),
+
+		S_SET( PIXEL( 0 ), 0, 0, MAX_INTENSITY ),
+		S_REPEAT( NUM_PIXELS ),
+			S_WAIT( 1 ),
+			S_SHIFT_UP(),
+		S_LOOP(),
+		S_END(),
+	S_LOOP(),
+};
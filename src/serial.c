@@ -0,0 +1,169 @@
+/**
+ * Frames streamed by the PC over the USART (build variant, see SERIAL_FRAMES in serial.h)
+ *
+ * The Serial program displays frames that the PC sends as packets (see SERIAL_PACKET_SIZE). The
+ * receive interrupt only appends the bytes to a ring buffer. The program, which is executed like
+ * any other animation program, looks for complete packets in the ring buffer, checks them in
+ * place and draws the newest valid one right from the ring buffer (an older one that has not been
+ * drawn yet is dropped). If no packet arrives, it does not draw anything, so the current frame
+ * remains visible.
+ *
+ * A packet takes ( 3 * NUM_PIXELS + 2 ) * 10 bits, i.e. 170 bits for 5 pixels, which is ca. 225
+ * frames per second at 38400 baud (see USART_BAUD). That is more than the PWM can display (a new
+ * frame becomes visible with the next PWM cycle, ca. 100 per second with PWM_ENGINE_STEP, 122 with
+ * the other engines), so the PC can send a new frame for every PWM cycle. The frame period of the
+ * module (see g_animation) adds a latency of up to one period, so keep it short.
+ *
+ * tools/sendframes.c sends test patterns to a serial port or a file, 'make bench' can feed such a
+ * file to the simulated USART.
+ */
+
+// clock frequency
+#ifndef F_CPU
+#define F_CPU 8000000L
+#endif
+
+#include "serial.h"
+
+#if SERIAL_FRAMES
+
+#include "ledterne.h"
+#include "telemetry.h"
+#include "usart.h"
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+
+// size of the receive ring buffer (a power of two, holds one byte less)
+#define RX_BUFFER_SIZE 64
+#define RX_BUFFER_MASK ( RX_BUFFER_SIZE - 1 )
+
+_Static_assert( 2 * SERIAL_PACKET_SIZE < RX_BUFFER_SIZE, "RX_BUFFER_SIZE is too small" );
+
+
+volatile uint16_t g_serialStats[ SERIAL_NUM_STATS ];
+
+// receive ring buffer: the interrupt handler writes at the head, the program reads at the tail
+static volatile uint8_t g_rxBuffer[ RX_BUFFER_SIZE ];
+static volatile uint8_t g_rxHead;
+static volatile uint8_t g_rxTail;
+
+
+/**
+ * @brief Interrupt handler for a received byte
+ */
+TELEMETRY_ISR( USART_RXC_vect, TELEMETRY_ISR_USART )
+{
+	// the error flags must be read before the data
+	uint8_t errors = UCSRA & ( (1<<FE) | (1<<DOR) );
+	uint8_t byte = UDR;
+	uint8_t head = g_rxHead;
+	uint8_t next = ( head + 1 ) & RX_BUFFER_MASK;
+
+	if( errors || next == g_rxTail )
+	{
+		g_serialStats[ SERIAL_RX_ERRORS ] += 1;
+		return;
+	}
+
+	g_rxBuffer[ head ] = byte;
+	g_rxHead = next;
+}
+
+
+// whether the packet at index start of the ring buffer is valid (it must be complete)
+static uint8_t isValidPacket( uint8_t start )
+{
+	uint8_t sum = 0;
+	uint8_t i;
+
+	for( i = 1; i <= 3 * NUM_PIXELS; i++ )
+	{
+		uint8_t byte = g_rxBuffer[ ( start + i ) & RX_BUFFER_MASK ];
+
+		if( byte & 0x80 )
+		{
+			return 0;
+		}
+
+		sum += byte;
+	}
+
+	return g_rxBuffer[ ( start + SERIAL_PACKET_SIZE - 1 ) & RX_BUFFER_MASK ] == ( sum & 0x7f );
+}
+
+
+uint8_t Serial_execute( void* prog )
+{
+	uint8_t tail = g_rxTail;
+	uint8_t packet = 0;
+	uint8_t found = 0;
+
+	while( 1 )
+	{
+		uint8_t available = ( g_rxHead - tail ) & RX_BUFFER_MASK;
+
+		// skip anything up to the next sync byte
+		while( available > 0 && g_rxBuffer[ tail ] != SERIAL_SYNC )
+		{
+			tail = ( tail + 1 ) & RX_BUFFER_MASK;
+			available -= 1;
+		}
+
+		if( available < SERIAL_PACKET_SIZE )
+		{
+			break;
+		}
+
+		if( isValidPacket( tail ) )
+		{
+			g_serialStats[ SERIAL_FRAMES_RECEIVED ] += 1;
+			packet = tail;
+			found = 1;
+			tail = ( tail + SERIAL_PACKET_SIZE ) & RX_BUFFER_MASK;
+		}
+		else
+		{
+			// search for the next sync byte after this one
+			g_serialStats[ SERIAL_FRAMES_INVALID ] += 1;
+			tail = ( tail + 1 ) & RX_BUFFER_MASK;
+		}
+	}
+
+	// The packet is still in the ring buffer: the interrupt handler does not overwrite it before
+	// the tail is released.
+	if( found )
+	{
+		uint8_t i;
+
+		for( i = 0; i < NUM_PIXELS; i++ )
+		{
+			uint8_t const base = packet + 1 + 3 * i;
+
+			setPixel( i,
+			          g_rxBuffer[ ( base + 0 ) & RX_BUFFER_MASK ],
+			          g_rxBuffer[ ( base + 1 ) & RX_BUFFER_MASK ],
+			          g_rxBuffer[ ( base + 2 ) & RX_BUFFER_MASK ] );
+		}
+	}
+
+	g_rxTail = tail;
+
+	// the program never ends (the button switches to the next module)
+	return 0;
+}
+
+
+/**
+ * @brief Set up the USART for receiving frames
+ *
+ * This has to be called before pwmInit() (which leaves RXD alone in this build).
+ */
+void serialInit( void )
+{
+	usartInit();
+	UCSRB |= (1<<RXEN) | (1<<RXCIE);
+}
+
+#endif
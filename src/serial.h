@@ -0,0 +1,45 @@
+#ifndef SERIAL_H_
+#define SERIAL_H_
+
+#include "ledterne.h"
+
+#include <inttypes.h>
+
+
+// 1: build the firmware with the Serial program, which displays frames sent by the PC over the
+// USART (see serial.c and the Makefile). The USART then needs RXD (PD0), so the blue LED of pixel 2
+// stays dark.
+#ifndef SERIAL_FRAMES
+#define SERIAL_FRAMES 0
+#endif
+
+// Frame packet: SERIAL_SYNC, the intensities of all pixels (R, G, B for pixel 0 first, 0 -
+// MAX_INTENSITY each) and a checksum (the sum of the intensities & 0x7f). All bytes but the sync
+// byte are below 0x80, so a receiver can always find the start of the next packet.
+#define SERIAL_SYNC 0xff
+#define SERIAL_PACKET_SIZE ( 3 * NUM_PIXELS + 2 )
+
+// serial statistics (see g_serialStats)
+enum
+{
+	SERIAL_FRAMES_RECEIVED, // valid packets
+	SERIAL_FRAMES_INVALID,  // packets with a wrong checksum or a sync byte in between
+	SERIAL_RX_ERRORS,       // bytes lost (receive buffer full, USART overrun or framing error)
+	SERIAL_NUM_STATS
+};
+
+#if SERIAL_FRAMES
+
+extern volatile uint16_t g_serialStats[ SERIAL_NUM_STATS ];
+
+void serialInit( void );
+uint8_t Serial_execute( void* prog );
+
+#else
+
+static inline void serialInit( void ) {}
+
+#endif
+
+
+#endif // SERIAL_H_
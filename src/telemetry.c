@@ -0,0 +1,280 @@
+/**
+ * Performance telemetry over the USART (build variant, see TELEMETRY in telemetry.h)
+ *
+ * The firmware counts the calls of its interrupt handlers and the time spent in them, the time of
+ * the frame updates of the main loop and the frames that came too late, and the maximum stack
+ * depth. Once per second, these counters are sent as a binary record (see telemetryRecord_t) on
+ * TXD (PD1) and reset. tools/telemetry.c decodes the records, from a serial port or from the
+ * output captured by 'make bench'.
+ *
+ * Times are sampled from timer 1, the millisecond time base (see animationTimerInit()), which
+ * counts in steps of 64 CPU cycles. An interrupt handler reads the counter at its beginning and end
+ * (see TELEMETRY_ISR()), so single calls are rounded to whole steps, but the sum over many calls
+ * is accurate.
+ *
+ * The record is put into a ring buffer, which the data register empty interrupt of the USART
+ * sends byte by byte, so sending never blocks the main loop. If the buffer is still full (which
+ * it should never be, a record takes ca. 8 ms at 38400 baud, see USART_BAUD), the record is
+ * dropped and counted.
+ *
+ * The maximum stack depth is determined by painting all of the RAM above the static variables with
+ * a canary value at reset (see paintStack()). The stack never shrinks below its lowest point, so
+ * the canaries that are still intact are the free RAM.
+ */
+
+// clock frequency
+#ifndef F_CPU
+#define F_CPU 8000000L
+#endif
+
+#include "telemetry.h"
+
+#if TELEMETRY
+
+#include "usart.h"
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+
+// size of the transmit ring buffer (a power of two, holds one byte less)
+#define TX_BUFFER_SIZE 64
+#define TX_BUFFER_MASK ( TX_BUFFER_SIZE - 1 )
+
+_Static_assert( sizeof( telemetryRecord_t ) < TX_BUFFER_SIZE, "TX_BUFFER_SIZE is too small" );
+
+// value of the unused RAM (see paintStack())
+#define STACK_CANARY 0xc5
+
+
+volatile uint16_t g_telemetryIsrCalls[ TELEMETRY_NUM_ISRS ];
+volatile uint32_t g_telemetryIsrTime;
+volatile uint16_t g_telemetryTicks;
+volatile uint8_t g_telemetryReportDue;
+
+// counters of the frame updates (main loop only)
+static uint16_t g_frames;
+static uint16_t g_lateFrames;
+static uint16_t g_missedFrames;
+static uint32_t g_frameTime;
+static uint16_t g_maxFrameTime;
+
+static uint8_t g_sequence;
+static uint8_t g_droppedRecords;
+
+// transmit ring buffer: the main loop writes at the head, the interrupt handler reads at the tail
+static volatile uint8_t g_txBuffer[ TX_BUFFER_SIZE ];
+static volatile uint8_t g_txHead;
+static volatile uint8_t g_txTail;
+
+// end of the static variables (provided by the linker)
+extern uint8_t _end;
+
+
+/**
+ * @brief Fill the RAM between the static variables and the stack with canaries
+ *
+ * This runs before main() (in section .init3, after the stack pointer has been set up), so the
+ * stack is still empty. It must not use the stack itself.
+ */
+void paintStack( void ) __attribute__(( naked, used, section( ".init3" ) ));
+void paintStack( void )
+{
+	uint8_t* p = &_end;
+
+	while( p <= (uint8_t*) RAMEND )
+	{
+		*p++ = STACK_CANARY;
+	}
+}
+
+
+/**
+ * @brief Bytes of RAM that have never been used by the stack
+ */
+static uint16_t freeStack( void )
+{
+	uint8_t const* p = &_end;
+
+	while( p <= (uint8_t const*) RAMEND && *p == STACK_CANARY )
+	{
+		p += 1;
+	}
+
+	return p - &_end;
+}
+
+
+/**
+ * @brief Interrupt handler for the USART being ready for the next byte
+ */
+TELEMETRY_ISR( USART_UDRE_vect, TELEMETRY_ISR_USART )
+{
+	uint8_t tail = g_txTail;
+
+	UDR = g_txBuffer[ tail ];
+	tail = ( tail + 1 ) & TX_BUFFER_MASK;
+	g_txTail = tail;
+
+	// disable the interrupt when the buffer is empty
+	if( tail == g_txHead )
+	{
+		UCSRB &= ~(1<<UDRIE);
+	}
+}
+
+
+/**
+ * @brief Queue data for transmission, return 0 if it does not fit into the buffer (nothing queued)
+ */
+static uint8_t send( uint8_t const* data, uint8_t size )
+{
+	uint8_t head = g_txHead;
+	uint8_t free = ( g_txTail - head - 1 ) & TX_BUFFER_MASK;
+
+	if( size > free )
+	{
+		return 0;
+	}
+
+	while( size-- > 0 )
+	{
+		g_txBuffer[ head ] = *data++;
+		head = ( head + 1 ) & TX_BUFFER_MASK;
+	}
+
+	g_txHead = head;
+	UCSRB |= (1<<UDRIE);
+
+	return 1;
+}
+
+
+/**
+ * @brief Current time in timer 1 counts (wraps around after ca. 0.5 s)
+ */
+uint16_t telemetryTimestamp( void )
+{
+	uint8_t sreg = SREG;
+	cli();
+
+	uint8_t count = TCNT1L;
+	uint16_t ticks = g_telemetryTicks;
+
+	// the counter has been reset, but the interrupt handler has not counted the tick yet
+	if( ( TIFR & (1<<OCF1A) ) && count < TELEMETRY_TICK_COUNTS / 2 )
+	{
+		ticks += 1;
+	}
+
+	SREG = sreg;
+
+	return ticks * TELEMETRY_TICK_COUNTS + count;
+}
+
+
+/**
+ * @brief Count a frame update of the main loop
+ *
+ * start is the timestamp at its beginning, due the number of frames that were due (more than one
+ * if the update came too late).
+ */
+void telemetryFrame( uint16_t start, uint8_t due )
+{
+	uint16_t time = telemetryTimestamp() - start;
+
+	g_frames += 1;
+	g_frameTime += time;
+
+	if( time > g_maxFrameTime )
+	{
+		g_maxFrameTime = time;
+	}
+
+	if( due > 1 )
+	{
+		g_lateFrames += 1;
+		g_missedFrames += due - 1;
+	}
+}
+
+
+/**
+ * @brief Send the record of the last second if it is due
+ */
+void telemetryReport( void )
+{
+	if( !g_telemetryReportDue )
+	{
+		return;
+	}
+
+	g_telemetryReportDue = 0;
+
+	telemetryRecord_t record;
+	uint8_t i;
+
+	record.sync[ 0 ] = TELEMETRY_SYNC0;
+	record.sync[ 1 ] = TELEMETRY_SYNC1;
+	record.size = sizeof( record );
+	record.sequence = g_sequence++;
+
+	cli();
+	for( i = 0; i < TELEMETRY_NUM_ISRS; i++ )
+	{
+		record.isrCalls[ i ] = g_telemetryIsrCalls[ i ];
+		g_telemetryIsrCalls[ i ] = 0;
+	}
+	record.isrTime = g_telemetryIsrTime;
+	g_telemetryIsrTime = 0;
+	sei();
+
+	record.frames = g_frames;
+	record.lateFrames = g_lateFrames;
+	record.missedFrames = g_missedFrames;
+	record.frameTime = g_frameTime;
+	record.maxFrameTime = g_maxFrameTime;
+	record.freeStack = freeStack();
+	record.droppedRecords = g_droppedRecords;
+
+	g_frames = 0;
+	g_lateFrames = 0;
+	g_missedFrames = 0;
+	g_frameTime = 0;
+	g_maxFrameTime = 0;
+
+	uint8_t const* bytes = (uint8_t const*) &record;
+	uint8_t sum = 0;
+
+	for( i = 0; i < sizeof( record ) - 1; i++ )
+	{
+		sum += bytes[ i ];
+	}
+
+	record.checksum = -sum;
+
+	if( send( bytes, sizeof( record ) ) )
+	{
+		g_droppedRecords = 0;
+	}
+	else
+	{
+		g_droppedRecords += g_droppedRecords < 255;
+	}
+}
+
+
+/**
+ * @brief Set up the USART for sending the records
+ *
+ * This has to be called before pwmInit() (which leaves TXD alone in the telemetry build).
+ */
+void telemetryInit( void )
+{
+	usartInit();
+
+	// the data register empty interrupt is enabled while there is data to send
+	UCSRB |= (1<<TXEN);
+}
+
+#endif
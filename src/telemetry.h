@@ -0,0 +1,129 @@
+#ifndef TELEMETRY_H_
+#define TELEMETRY_H_
+
+#include <inttypes.h>
+
+
+// 1: build the firmware with telemetry (see telemetry.c and the Makefile). The USART then needs TXD
+// (PD1), so the green LED of pixel 2 stays dark.
+#ifndef TELEMETRY
+#define TELEMETRY 0
+#endif
+
+// timer 1 counts per millisecond tick (see animationTimerInit()), one count is 64 CPU cycles
+#define TELEMETRY_TICK_COUNTS 125
+#define TELEMETRY_CYCLES_PER_COUNT 64
+
+// interrupt handlers counted by the telemetry
+enum
+{
+	TELEMETRY_ISR_PWM,    // timer 2
+	TELEMETRY_ISR_TICK,   // timer 1 (time base)
+	TELEMETRY_ISR_BUTTON, // INT1 and timer 0
+	TELEMETRY_ISR_USART,  // transmitting the records (and receiving frames, see serial.h)
+	TELEMETRY_NUM_ISRS
+};
+
+// first bytes of a record
+#define TELEMETRY_SYNC0 0xa5
+#define TELEMETRY_SYNC1 0x5a
+
+// Record with the counters of the last second, sent once per second. All fields are little endian
+// and times are in timer 1 counts (TELEMETRY_CYCLES_PER_COUNT). The sum of all bytes of the record
+// (including the checksum) is 0.
+typedef struct __attribute__(( packed ))
+{
+	uint8_t sync[ 2 ];
+	uint8_t size;     // of the whole record
+	uint8_t sequence; // incremented with each record (to detect lost ones)
+
+	uint16_t isrCalls[ TELEMETRY_NUM_ISRS ];
+	uint32_t isrTime;       // total time spent in the interrupt handlers
+
+	uint16_t frames;        // frame updates of the main loop
+	uint16_t lateFrames;    // frame updates that came too late for one or more frames
+	uint16_t missedFrames;  // frames missed by them (caught up with or skipped)
+	uint32_t frameTime;     // total time of the frame updates (including interrupts)
+	uint16_t maxFrameTime;
+
+	uint16_t freeStack;     // bytes of RAM never used by the stack since the reset
+	uint8_t droppedRecords; // records not sent since this one's predecessor (buffer full)
+
+	uint8_t checksum;
+}
+telemetryRecord_t;
+
+
+#if TELEMETRY
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+extern volatile uint16_t g_telemetryIsrCalls[ TELEMETRY_NUM_ISRS ];
+extern volatile uint32_t g_telemetryIsrTime;
+extern volatile uint16_t g_telemetryTicks;
+extern volatile uint8_t g_telemetryReportDue;
+
+/**
+ * @brief Define an interrupt handler that is counted by the telemetry
+ *
+ * The handler's body becomes an inline function, which is wrapped in sampling timer 1 (so the
+ * handler may return anywhere). The time is sampled with a resolution of 64 CPU cycles, which
+ * averages out over many calls. This costs a few dozen cycles per call.
+ */
+#define TELEMETRY_ISR( vector, isr )                                                 \
+	static inline void vector##_body( void ) __attribute__(( always_inline ));      \
+	ISR( vector )                                                                   \
+	{                                                                               \
+		uint8_t start = TCNT1L;                                                     \
+		vector##_body();                                                            \
+		int8_t t = TCNT1L - start;                                                  \
+		g_telemetryIsrCalls[ isr ] += 1;                                            \
+		g_telemetryIsrTime += t >= 0 ? t : t + TELEMETRY_TICK_COUNTS;               \
+	}                                                                               \
+	static inline void vector##_body( void )
+
+/**
+ * @brief Count a tick of the time base (from its interrupt handler)
+ */
+static inline void telemetryTick( void )
+{
+	static uint16_t countdown = 1000;
+
+	g_telemetryTicks += 1;
+
+	if( --countdown == 0 )
+	{
+		countdown = 1000;
+		g_telemetryReportDue = 1;
+	}
+}
+
+/**
+ * @brief Whether telemetryReport() has to send a record (the main loop must not sleep then)
+ */
+static inline uint8_t telemetryReportPending( void )
+{
+	return g_telemetryReportDue;
+}
+
+void telemetryInit( void );
+uint16_t telemetryTimestamp( void );
+void telemetryFrame( uint16_t start, uint8_t due );
+void telemetryReport( void );
+
+#else
+
+#define TELEMETRY_ISR( vector, isr ) ISR( vector )
+
+static inline void telemetryTick( void ) {}
+static inline uint8_t telemetryReportPending( void ) { return 0; }
+static inline void telemetryInit( void ) {}
+static inline uint16_t telemetryTimestamp( void ) { return 0; }
+static inline void telemetryFrame( uint16_t start, uint8_t due ) {}
+static inline void telemetryReport( void ) {}
+
+#endif
+
+
+#endif // TELEMETRY_H_
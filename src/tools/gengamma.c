@@ -0,0 +1,206 @@
+/**
+ * Generator for the gamma correction tables of the firmware
+ *
+ * The human eye perceives brightness roughly logarithmically, so the LED intensities used by the
+ * animations (0 - MAX_INTENSITY) need to be mapped to PWM duty cycles by a power function:
+ *
+ *     duty( i ) = balance * PWM_MAX_DUTY * ( i / MAX_INTENSITY )^gamma
+ *
+ * There is a separate table for each color channel. The balance factor of a channel (0 - 1) dims
+ * the channel's brightest LEDs to match the others, so that e.g. white really looks white. Since
+ * this is all done at build time, there is no runtime cost.
+ *
+ * The fractional part of a duty cycle is dithered (see PWM_DITHER_BITS in pwm.h): the LED is lit
+ * one step longer in some PWM cycles only, e.g. in every 16th cycle for 1/16 step. For a dark LED,
+ * that extra step is a large share of its brightness, so a slow dither rate would be visible as
+ * flicker. Below 2^PWM_DITHER_BITS whole steps (where one step is more than 1/16 of the
+ * brightness), the duty cycles are therefore rounded to half steps, which alternate in every other
+ * PWM cycle (ca. 50 Hz). Every non-zero intensity is lit for at least one whole step, and where the
+ * power function yields duty cycles that are too close together (or even 0) at the dark end, they
+ * are raised to the previous entry plus half a step, so each intensity is brighter than the
+ * previous one.
+ *
+ * The tables are indexed by fine intensities (see setPixelFine() in ledterne.c), with
+ * INTENSITY_FRACTION_BITS more entries between two whole intensities. The whole intensities get
+ * the duty cycles described above. The entries between them follow the power function from one
+ * to the next, scaled to fit, and rounded like the whole ones (so at the dark end, where a half
+ * step is the finest difference, several fine intensities share a duty cycle). Below intensity 1,
+ * they are either off or lit for one whole step, too.
+ *
+ * The tables are written as C header to stdout (see the Makefile). MAX_INTENSITY,
+ * MAX_FINE_INTENSITY and PWM_MAX_DUTY are taken from the firmware's headers, so this has to be
+ * compiled with the same PWM_DITHER_BITS and INTENSITY_FRACTION_BITS as the firmware.
+ */
+
+#include "ledterne.h"
+#include "pwm.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+
+static char const* const g_channelNames[ 3 ] = { "red", "green", "blue" };
+
+// one whole PWM step, and the smallest difference between duty cycles of dark LEDs (half a step,
+// a whole one without dithering)
+static long const g_step = 1L << PWM_DITHER_BITS;
+static long const g_darkUnit = PWM_DITHER_BITS > 0 ? ( 1L << PWM_DITHER_BITS ) / 2 : 1;
+
+
+// round a duty cycle to the finest difference of its brightness
+static long roundDuty( double exact )
+{
+	long const duty = lround( exact );
+	long const unit = duty < ( g_step << PWM_DITHER_BITS ) ? g_darkUnit : 1;
+
+	return ( duty + unit / 2 ) / unit * unit;
+}
+
+
+static void usage( char const* argv0 )
+{
+	fprintf( stderr,
+		"usage: %s [-g gamma] [-w \"red green blue\"]\n"
+		"\n"
+		"  -g gamma    exponent of the power function (default 2.8)\n"
+		"  -w balance  relative brightness of the color channels, 0 - 1 (default \"1 1 1\")\n",
+		argv0 );
+
+	exit( 2 );
+}
+
+
+int main( int argc, char** argv )
+{
+	double gamma = 2.8;
+	double balance[ 3 ] = { 1.0, 1.0, 1.0 };
+	int opt;
+
+	while( ( opt = getopt( argc, argv, "g:w:h" ) ) != -1 )
+	{
+		switch( opt )
+		{
+			case 'g':
+				gamma = atof( optarg );
+				break;
+			case 'w':
+				if( sscanf( optarg, "%lf %lf %lf", &balance[ 0 ], &balance[ 1 ], &balance[ 2 ] ) != 3 )
+				{
+					usage( argv[ 0 ] );
+				}
+				break;
+			default:
+				usage( argv[ 0 ] );
+		}
+	}
+
+	// duty cycles of the whole intensities
+	long duties[ MAX_INTENSITY + 1 ];
+	int c, i;
+
+	if( gamma <= 0 )
+	{
+		fprintf( stderr, "%s: gamma must be positive\n", argv[ 0 ] );
+		return 1;
+	}
+
+	for( c = 0; c < 3; c++ )
+	{
+		if( balance[ c ] <= 0 || balance[ c ] > 1 )
+		{
+			fprintf( stderr, "%s: white balance must be 0 - 1\n", argv[ 0 ] );
+			return 1;
+		}
+	}
+
+	printf( "// Gamma correction tables, generated by tools/gengamma. Do not edit.\n"
+	        "//\n"
+	        "// gamma %.2f, white balance %.3f %.3f %.3f, %d fine intensities, "
+	        "%d fractional PWM bits\n"
+	        "\n"
+	        "#ifndef GAMMA_H_\n"
+	        "#define GAMMA_H_\n"
+	        "\n"
+	        "#include \"ledterne.h\"\n"
+	        "#include \"pwm.h\"\n"
+	        "\n"
+	        "#include <avr/pgmspace.h>\n"
+	        "\n"
+	        "#if MAX_INTENSITY != %d || INTENSITY_FRACTION_BITS != %d || PWM_DITHER_BITS != %d\n"
+	        "#error \"gamma.h does not match the configuration, run 'make clean'\"\n"
+	        "#endif\n"
+	        "\n"
+	        "// PWM duty cycles for all fine intensities of each color channel (red, green, blue)\n"
+	        "static pwmDuty_t const g_gamma[ 3 ][ MAX_FINE_INTENSITY + 1 ] PROGMEM =\n"
+	        "{\n",
+	        gamma, balance[ 0 ], balance[ 1 ], balance[ 2 ], MAX_FINE_INTENSITY + 1,
+	        PWM_DITHER_BITS, MAX_INTENSITY, INTENSITY_FRACTION_BITS, PWM_DITHER_BITS );
+
+	for( c = 0; c < 3; c++ )
+	{
+		long previous = 0;
+
+		for( i = 0; i <= MAX_INTENSITY; i++ )
+		{
+			double x = (double) i / MAX_INTENSITY;
+			long duty = roundDuty( balance[ c ] * PWM_MAX_DUTY * pow( x, gamma ) );
+
+			if( i > 0 && duty < g_step )
+			{
+				duty = g_step;
+			}
+
+			if( i > 0 && duty <= previous )
+			{
+				duty = previous + ( duty < ( g_step << PWM_DITHER_BITS ) ? g_darkUnit : 1 );
+			}
+
+			if( duty > PWM_MAX_DUTY )
+			{
+				fprintf( stderr, "%s: too many intensities for the dark end of the %s channel\n",
+				         argv[ 0 ], g_channelNames[ c ] );
+				return 1;
+			}
+
+			duties[ i ] = duty;
+			previous = duty;
+		}
+
+		printf( "\t// %s\n\t{", g_channelNames[ c ] );
+
+		for( i = 0; i <= MAX_FINE_INTENSITY; i++ )
+		{
+			int const whole = i >> INTENSITY_FRACTION_BITS;
+			int const fraction = i & ( ( 1 << INTENSITY_FRACTION_BITS ) - 1 );
+			long duty = duties[ whole ];
+
+			if( fraction )
+			{
+				// position on the power function between the two whole intensities (0 - 1)
+				double const from = pow( (double) whole / MAX_INTENSITY, gamma );
+				double const to = pow( (double) ( whole + 1 ) / MAX_INTENSITY, gamma );
+				double const x = (double) i / MAX_FINE_INTENSITY;
+				double const t = ( pow( x, gamma ) - from ) / ( to - from );
+
+				duty = roundDuty( duty + ( duties[ whole + 1 ] - duty ) * t );
+
+				if( duty > 0 && duty < g_step )
+				{
+					duty = g_step;
+				}
+			}
+
+			printf( "%s%5ld,", i % 8 == 0 ? "\n\t\t" : " ", duty );
+		}
+
+		printf( "\n\t},\n" );
+	}
+
+	printf( "};\n"
+	        "\n"
+	        "#endif // GAMMA_H_\n" );
+
+	return 0;
+}
@@ -0,0 +1,340 @@
+/**
+ * Pre-renderer for the frame streams of the firmware
+ *
+ * Runs animation programs on the PC (like the host harness, see host/) and writes their frames as
+ * compressed streams for Stream_execute() (see animations.h for the format). Each program is
+ * rendered for the given number of runs, after which the player starts again at the beginning of
+ * the stream. So the stream only matches the program if its frames repeat after these runs.
+ *
+ * The streams are written as C header to stdout (see the Makefile), a report to stderr: the size
+ * of the stream compared to the raw frames (one byte per channel), and the number of tokens per
+ * frame, which determines the cost of decoding a frame on the chip. The cycles per frame are an
+ * estimate for avr-gcc -Os, 'make bench' measures Stream_execute().
+ */
+
+#include "animations.h"
+#include "ledterne.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+
+// cycles of Stream_execute() (estimate): per frame (including drawing it) and per token
+#define DECODE_CYCLES_PER_FRAME 250
+#define DECODE_CYCLES_PER_TOKEN 25
+
+// streams longer than this are considered a mistake (the ATmega8 has 8 KiB of flash)
+#define MAX_STREAM_SIZE 8192
+
+// maximum number of frames per stream
+#define MAX_FRAMES 65536UL
+
+
+typedef struct
+{
+	char const* name;
+	void (*init)( void* );
+	uint8_t (*execute)( void* );
+}
+program_t;
+
+#define PROGRAM( name )                         \
+	{                                           \
+		#name,                                  \
+		(void (*)( void* )) &name##_init,       \
+		(uint8_t (*)( void* )) &name##_execute, \
+	}
+
+static program_t const g_programs[] =
+{
+	PROGRAM( MixedColorBlending ),
+	PROGRAM( KnightRider ),
+	PROGRAM( ColoredConveyor ),
+	PROGRAM( TestDisplays ),
+	PROGRAM( Rainbow ),
+	PROGRAM( CandleFlicker ),
+};
+
+#define NUM_PROGRAMS ( sizeof( g_programs ) / sizeof( g_programs[ 0 ] ) )
+
+
+// frame API stub ----------------------------------------------------------------------------------
+
+static uint8_t g_frame[ STREAM_FRAME_SIZE ];
+static unsigned long g_numFrames;
+
+// time between two frames for the programs that use animationTime() (ms), the stream has to be
+// played at this frame period
+#define FRAME_PERIOD 20
+
+uint16_t animationTime( void )
+{
+	return g_numFrames * FRAME_PERIOD;
+}
+
+void beginFrame( void )
+{
+}
+
+void setPixel( uint8_t pixelIndex, uint8_t r, uint8_t g, uint8_t b )
+{
+	if( pixelIndex >= NUM_PIXELS )
+	{
+		return;
+	}
+
+	g_frame[ 3 * pixelIndex + 0 ] = r <= MAX_INTENSITY ? r : MAX_INTENSITY;
+	g_frame[ 3 * pixelIndex + 1 ] = g <= MAX_INTENSITY ? g : MAX_INTENSITY;
+	g_frame[ 3 * pixelIndex + 2 ] = b <= MAX_INTENSITY ? b : MAX_INTENSITY;
+}
+
+// the streams hold whole intensities
+void setPixelFine( uint8_t pixelIndex, uint8_t r, uint8_t g, uint8_t b )
+{
+	setPixel( pixelIndex, r >> INTENSITY_FRACTION_BITS, g >> INTENSITY_FRACTION_BITS,
+	          b >> INTENSITY_FRACTION_BITS );
+}
+
+void commitFrame( void )
+{
+	g_numFrames += 1;
+}
+
+
+// encoder -----------------------------------------------------------------------------------------
+
+static uint8_t g_stream[ MAX_STREAM_SIZE ];
+static size_t g_streamSize;
+
+static void emit( uint8_t token )
+{
+	if( g_streamSize == MAX_STREAM_SIZE )
+	{
+		fprintf( stderr, "prerender: stream exceeds %d bytes\n", MAX_STREAM_SIZE );
+		exit( 1 );
+	}
+
+	g_stream[ g_streamSize++ ] = token;
+}
+
+
+// number of channels still to be skipped (not emitted yet)
+static unsigned int g_skip;
+
+static void flushSkip( void )
+{
+	while( g_skip > 0 )
+	{
+		unsigned int n = g_skip < 64 ? g_skip : 64;
+		emit( STREAM_SKIP | ( n - 1 ) );
+		g_skip -= n;
+	}
+}
+
+
+// Encode frame relative to previous, return the number of tokens. Unchanged channels at the end
+// are left in g_skip, so that they can be merged with the ones of the next frame.
+static unsigned int encodeFrame( uint8_t const* frame, uint8_t const* previous )
+{
+	size_t start = g_streamSize;
+	unsigned int ch = 0;
+
+	while( ch < STREAM_FRAME_SIZE )
+	{
+		int delta = frame[ ch ] - previous[ ch ];
+		unsigned int n;
+
+		if( delta == 0 )
+		{
+			g_skip += 1;
+			ch += 1;
+			continue;
+		}
+
+		flushSkip();
+
+		// channels that are the same as the ones of the previous pixel
+		for( n = 0; ch + n >= 3 && ch + n < STREAM_FRAME_SIZE && frame[ ch + n ] == frame[ ch + n - 3 ]; n++ )
+		{
+		}
+
+		if( n >= 2 )
+		{
+			emit( STREAM_COPY | ( n - 1 ) );
+			ch += n;
+		}
+		else if( delta >= -4 && delta <= 4 )
+		{
+			// the delta token can skip up to 7 unchanged channels behind the changed one
+			for( n = 0; n < 7 && ch + 1 + n < STREAM_FRAME_SIZE && frame[ ch + 1 + n ] == previous[ ch + 1 + n ]; n++ )
+			{
+			}
+
+			emit( STREAM_DELTA | ( ( delta > 0 ? delta - 1 : 3 - delta ) << 3 ) | n );
+			ch += 1 + n;
+		}
+		else
+		{
+			emit( STREAM_LITERAL | frame[ ch ] );
+			ch += 1;
+		}
+	}
+
+	return g_streamSize - start;
+}
+
+
+static void usage( char const* argv0 )
+{
+	fprintf( stderr,
+		"usage: %s program[:runs]...\n"
+		"\n"
+		"  Render the given number of runs (default 1) of each program.\n"
+		"\n"
+		"programs:",
+		argv0 );
+
+	unsigned int i;
+	for( i = 0; i < NUM_PROGRAMS; i++ )
+	{
+		fprintf( stderr, " %s", g_programs[ i ].name );
+	}
+	fprintf( stderr, "\n" );
+
+	exit( 2 );
+}
+
+
+int main( int argc, char** argv )
+{
+	int a;
+
+	if( argc < 2 )
+	{
+		usage( argv[ 0 ] );
+	}
+
+	printf( "// Pre-rendered frame streams, generated by tools/prerender. Do not edit.\n"
+	        "\n"
+	        "#ifndef STREAMS_H_\n"
+	        "#define STREAMS_H_\n"
+	        "\n"
+	        "#include \"ledterne.h\"\n"
+	        "\n"
+	        "#include <avr/pgmspace.h>\n"
+	        "\n"
+	        "#if NUM_PIXELS != %d\n"
+	        "#error \"streams.h does not match the configuration, run 'make clean'\"\n"
+	        "#endif\n",
+	        NUM_PIXELS );
+
+	fprintf( stderr, "%-20s %6s %5s %7s %7s %6s %13s %14s\n", "stream", "frames", "runs", "raw",
+	         "stream", "ratio", "tokens/frame", "cycles/frame" );
+
+	for( a = 1; a < argc; a++ )
+	{
+		char name[ 64 ];
+		unsigned long runs = 1;
+		unsigned int i;
+
+		snprintf( name, sizeof( name ), "%s", argv[ a ] );
+
+		char* colon = strchr( name, ':' );
+		if( colon )
+		{
+			*colon = 0;
+			runs = strtoul( colon + 1, NULL, 0 );
+		}
+
+		program_t const* program = NULL;
+		for( i = 0; i < NUM_PROGRAMS; i++ )
+		{
+			if( strcmp( g_programs[ i ].name, name ) == 0 )
+			{
+				program = &g_programs[ i ];
+			}
+		}
+
+		if( !program || runs == 0 )
+		{
+			usage( argv[ 0 ] );
+		}
+
+		static AnimationProgramStorage prog;
+		uint8_t previous[ STREAM_FRAME_SIZE ];
+		unsigned long numFrames = 0;
+		unsigned long numRuns = 0;
+		unsigned long numTokens = 0;
+		unsigned int maxTokens = 0;
+
+		memset( previous, 0, sizeof( previous ) );
+		memset( g_frame, 0, sizeof( g_frame ) );
+		g_streamSize = 0;
+		g_skip = 0;
+		g_numFrames = 0;
+
+		program->init( &prog );
+
+		while( numRuns < runs )
+		{
+			if( numFrames == MAX_FRAMES )
+			{
+				fprintf( stderr, "%s: more than %lu frames\n", name, MAX_FRAMES );
+				return 1;
+			}
+
+			beginFrame();
+			uint8_t finished = program->execute( &prog );
+			commitFrame();
+
+			unsigned int numFrameTokens = encodeFrame( g_frame, previous );
+			memcpy( previous, g_frame, sizeof( previous ) );
+			numFrames += 1;
+
+			if( finished )
+			{
+				// a skip must not run across the marker
+				flushSkip();
+				emit( STREAM_END_RUN );
+				numRuns += 1;
+			}
+
+			// the skip tokens are counted in the frame they start in, the skipped frames are free
+			numFrameTokens += g_skip > 0;
+			numTokens += numFrameTokens;
+			maxTokens = numFrameTokens > maxTokens ? numFrameTokens : maxTokens;
+		}
+
+		emit( STREAM_END_STREAM );
+
+		printf( "\n"
+		        "// %s, %lu runs, %lu frames\n"
+		        "static uint8_t const g_stream%s[] PROGMEM =\n"
+		        "{",
+		        name, numRuns, numFrames, name );
+
+		size_t j;
+		for( j = 0; j < g_streamSize; j++ )
+		{
+			printf( "%s0x%02x,", j % 12 == 0 ? "\n\t" : " ", g_stream[ j ] );
+		}
+
+		printf( "\n};\n" );
+
+		unsigned long rawSize = numFrames * STREAM_FRAME_SIZE;
+
+		fprintf( stderr, "%-20s %6lu %5lu %7lu %7zu %5.1f:1 %6.1f / %4u %6.0f / %5u\n",
+		         name, numFrames, numRuns, rawSize, g_streamSize, (double) rawSize / g_streamSize,
+		         (double) numTokens / numFrames, maxTokens,
+		         DECODE_CYCLES_PER_FRAME + DECODE_CYCLES_PER_TOKEN * (double) numTokens / numFrames,
+		         DECODE_CYCLES_PER_FRAME + DECODE_CYCLES_PER_TOKEN * maxTokens );
+	}
+
+	printf( "\n"
+	        "#endif // STREAMS_H_\n" );
+
+	return 0;
+}
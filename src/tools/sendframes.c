@@ -0,0 +1,222 @@
+/**
+ * Sends test patterns to the Serial program of the firmware (see serial.h, build with
+ * SERIAL_FRAMES=1)
+ *
+ * Writes frame packets to a serial port (which is set up for USART_BAUD), to a file (e.g. the input
+ * fed to the simulated USART by 'make bench') or to stdout. On a serial port, the packets are sent
+ * at the given frame rate, otherwise they are written back to back.
+ *
+ * Patterns:
+ *
+ * - rainbow: the hues of the pixels run around the color wheel, one turn per second
+ * - chase: a white pixel moves from pixel to pixel, five steps per second
+ * - ramp: all pixels fade from dark to white and back, once per second
+ */
+
+#include "ledterne.h"
+#include "serial.h"
+#include "usart.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+
+#if USART_BAUD != 38400
+#error "adjust the baud rate in setupSerialPort()"
+#endif
+
+
+static void usage( char const* argv0 )
+{
+	fprintf( stderr,
+		"usage: %s [-p pattern] [-f fps] [-n frames] [device or file]\n"
+		"\n"
+		"  Send frame packets to a serial port (%d baud, 8N1), to a file or to stdout.\n"
+		"\n"
+		"  -p pattern  rainbow, chase or ramp (default rainbow)\n"
+		"  -f fps      frames per second (default 100, paced on a serial port only)\n"
+		"  -n frames   number of frames (default: endless)\n",
+		argv0, USART_BAUD );
+	exit( 2 );
+}
+
+
+// set up a serial port for sending the packets
+static int setupSerialPort( int fd )
+{
+	struct termios tio;
+
+	if( tcgetattr( fd, &tio ) != 0 )
+	{
+		return 0;
+	}
+
+	cfmakeraw( &tio );
+	cfsetispeed( &tio, B38400 );
+	cfsetospeed( &tio, B38400 );
+	tio.c_cflag |= CLOCAL | CREAD;
+
+	return tcsetattr( fd, TCSANOW, &tio ) == 0;
+}
+
+
+// the color at a position of the color wheel (0 - 6 * MAX_INTENSITY)
+static void wheel( int position, uint8_t* rgb )
+{
+	int const sector = position / MAX_INTENSITY;
+	int const rise = position % MAX_INTENSITY;
+	int const fall = MAX_INTENSITY - rise;
+
+	switch( sector % 6 )
+	{
+		case 0: rgb[ 0 ] = MAX_INTENSITY; rgb[ 1 ] = rise; rgb[ 2 ] = 0; break;
+		case 1: rgb[ 0 ] = fall; rgb[ 1 ] = MAX_INTENSITY; rgb[ 2 ] = 0; break;
+		case 2: rgb[ 0 ] = 0; rgb[ 1 ] = MAX_INTENSITY; rgb[ 2 ] = rise; break;
+		case 3: rgb[ 0 ] = 0; rgb[ 1 ] = fall; rgb[ 2 ] = MAX_INTENSITY; break;
+		case 4: rgb[ 0 ] = rise; rgb[ 1 ] = 0; rgb[ 2 ] = MAX_INTENSITY; break;
+		default: rgb[ 0 ] = MAX_INTENSITY; rgb[ 1 ] = 0; rgb[ 2 ] = fall; break;
+	}
+}
+
+
+// the pixels of a frame at time t (seconds)
+static void renderPattern( char const* pattern, double t, uint8_t* pixels )
+{
+	int const wheelSize = 6 * MAX_INTENSITY;
+	double const phase = t - (int) t;
+	int i;
+
+	for( i = 0; i < NUM_PIXELS; i++ )
+	{
+		uint8_t* rgb = &pixels[ 3 * i ];
+
+		if( strcmp( pattern, "chase" ) == 0 )
+		{
+			uint8_t on = (int) ( 5 * t ) % NUM_PIXELS == i ? MAX_INTENSITY : 0;
+			rgb[ 0 ] = rgb[ 1 ] = rgb[ 2 ] = on;
+		}
+		else if( strcmp( pattern, "ramp" ) == 0 )
+		{
+			uint8_t level = (int) ( 2 * MAX_INTENSITY * ( phase < 0.5 ? phase : 1.0 - phase ) + 0.5 );
+			rgb[ 0 ] = rgb[ 1 ] = rgb[ 2 ] = level;
+		}
+		else
+		{
+			wheel( ( (int) ( phase * wheelSize ) + i * wheelSize / NUM_PIXELS ) % wheelSize, rgb );
+		}
+	}
+}
+
+
+int main( int argc, char** argv )
+{
+	char const* pattern = "rainbow";
+	double fps = 100.0;
+	long numFrames = -1;
+	int fd = STDOUT_FILENO;
+	int opt;
+
+	while( ( opt = getopt( argc, argv, "p:f:n:h" ) ) != -1 )
+	{
+		switch( opt )
+		{
+			case 'p':
+				pattern = optarg;
+				break;
+			case 'f':
+				fps = atof( optarg );
+				break;
+			case 'n':
+				numFrames = atol( optarg );
+				break;
+			default:
+				usage( argv[ 0 ] );
+		}
+	}
+
+	if( optind + 1 < argc || fps <= 0.0
+	    || ( strcmp( pattern, "rainbow" ) != 0 && strcmp( pattern, "chase" ) != 0
+	         && strcmp( pattern, "ramp" ) != 0 ) )
+	{
+		usage( argv[ 0 ] );
+	}
+
+	if( optind < argc )
+	{
+		fd = open( argv[ optind ], O_WRONLY | O_CREAT | O_TRUNC | O_NOCTTY, 0644 );
+		if( fd < 0 )
+		{
+			perror( argv[ optind ] );
+			return 1;
+		}
+	}
+
+	int const paced = isatty( fd );
+
+	if( paced && !setupSerialPort( fd ) )
+	{
+		perror( "cannot set up the serial port" );
+		return 1;
+	}
+
+	// a packet takes 10 bits per byte on the serial line
+	double const maxFps = USART_BAUD / ( 10.0 * SERIAL_PACKET_SIZE );
+
+	if( paced && fps > maxFps )
+	{
+		fprintf( stderr, "warning: at most %.1f frames per second fit into %d baud\n",
+		         maxFps, USART_BAUD );
+	}
+
+	struct timespec start;
+	clock_gettime( CLOCK_MONOTONIC, &start );
+
+	long frame;
+
+	for( frame = 0; numFrames < 0 || frame < numFrames; frame++ )
+	{
+		uint8_t packet[ SERIAL_PACKET_SIZE ];
+		uint8_t sum = 0;
+		int i;
+
+		packet[ 0 ] = SERIAL_SYNC;
+		renderPattern( pattern, frame / fps, &packet[ 1 ] );
+
+		for( i = 1; i <= 3 * NUM_PIXELS; i++ )
+		{
+			sum += packet[ i ];
+		}
+
+		packet[ SERIAL_PACKET_SIZE - 1 ] = sum & 0x7f;
+
+		if( write( fd, packet, sizeof( packet ) ) != (ssize_t) sizeof( packet ) )
+		{
+			perror( "write" );
+			return 1;
+		}
+
+		// wait for the time of the next frame
+		if( paced )
+		{
+			double const next = ( frame + 1 ) / fps;
+			struct timespec due = start;
+
+			due.tv_sec += (time_t) next;
+			due.tv_nsec += (long) ( ( next - (time_t) next ) * 1e9 );
+			if( due.tv_nsec >= 1000000000L )
+			{
+				due.tv_sec += 1;
+				due.tv_nsec -= 1000000000L;
+			}
+
+			clock_nanosleep( CLOCK_MONOTONIC, TIMER_ABSTIME, &due, NULL );
+		}
+	}
+
+	return 0;
+}
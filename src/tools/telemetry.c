@@ -0,0 +1,185 @@
+/**
+ * Decoder for the telemetry records of the firmware (see telemetry.h, build with TELEMETRY=1)
+ *
+ * Reads the output of the USART from a serial port (which is set up for USART_BAUD), from a
+ * file (e.g. the output captured by 'make bench') or from stdin, and prints one line per record:
+ * the calls of the interrupt handlers per second and the CPU load of the interrupt handlers and of
+ * the frame updates, the frame updates per second and those that came too late, the average and
+ * maximum cycles of a frame update, and the free stack. Corrupted records (wrong checksum) are
+ * skipped, as well as any other data between the records.
+ */
+
+#include "telemetry.h"
+#include "usart.h"
+
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+
+// clock frequency of the firmware
+#define F_CPU 8000000UL
+
+#if USART_BAUD != 38400
+#error "adjust the baud rate in setupSerialPort()"
+#endif
+
+
+static void usage( char const* argv0 )
+{
+	fprintf( stderr,
+		"usage: %s [device or file]\n"
+		"\n"
+		"  Decode the telemetry records from a serial port (%d baud, 8N1), from a file or from\n"
+		"  stdin.\n",
+		argv0, USART_BAUD );
+	exit( 2 );
+}
+
+
+// set up a serial port for receiving the records
+static int setupSerialPort( int fd )
+{
+	struct termios tio;
+
+	if( tcgetattr( fd, &tio ) != 0 )
+	{
+		return 0;
+	}
+
+	cfmakeraw( &tio );
+	cfsetispeed( &tio, B38400 );
+	cfsetospeed( &tio, B38400 );
+	tio.c_cflag |= CLOCAL | CREAD;
+
+	return tcsetattr( fd, TCSANOW, &tio ) == 0;
+}
+
+
+static void printRecord( telemetryRecord_t const* r )
+{
+	static int header = 1;
+	double const countsPerSecond = (double) F_CPU / TELEMETRY_CYCLES_PER_COUNT;
+
+	if( header )
+	{
+		printf( "%4s %7s %6s %6s %6s %7s   %6s %5s %6s %9s %9s %7s   %6s %4s\n",
+		        "seq", "pwm/s", "tick/s", "btn/s", "uart/s", "isr %",
+		        "frm/s", "late", "missed", "avg cyc", "max cyc", "frm %", "stack", "lost" );
+		header = 0;
+	}
+
+	printf( "%4u %7u %6u %6u %6u %7.2f   %6u %5u %6u %9.0f %9lu %7.2f   %6u %4u\n",
+	        r->sequence,
+	        r->isrCalls[ TELEMETRY_ISR_PWM ], r->isrCalls[ TELEMETRY_ISR_TICK ],
+	        r->isrCalls[ TELEMETRY_ISR_BUTTON ], r->isrCalls[ TELEMETRY_ISR_USART ],
+	        100.0 * r->isrTime / countsPerSecond,
+	        r->frames, r->lateFrames, r->missedFrames,
+	        r->frames > 0 ? (double) r->frameTime * TELEMETRY_CYCLES_PER_COUNT / r->frames : 0.0,
+	        (unsigned long) r->maxFrameTime * TELEMETRY_CYCLES_PER_COUNT,
+	        100.0 * r->frameTime / countsPerSecond,
+	        r->freeStack, r->droppedRecords );
+
+	fflush( stdout );
+}
+
+
+int main( int argc, char** argv )
+{
+	int fd = STDIN_FILENO;
+
+	if( argc > 2 || ( argc == 2 && argv[ 1 ][ 0 ] == '-' ) )
+	{
+		usage( argv[ 0 ] );
+	}
+
+	if( argc == 2 )
+	{
+		fd = open( argv[ 1 ], O_RDONLY | O_NOCTTY );
+		if( fd < 0 )
+		{
+			perror( argv[ 1 ] );
+			return 1;
+		}
+	}
+
+	if( isatty( fd ) && !setupSerialPort( fd ) )
+	{
+		perror( "cannot set up the serial port" );
+		return 1;
+	}
+
+	// the record being received
+	uint8_t record[ sizeof( telemetryRecord_t ) ];
+	size_t size = 0;
+	unsigned long numRecords = 0;
+	unsigned long numErrors = 0;
+	int expectedSequence = -1;
+	unsigned long numLost = 0;
+
+	uint8_t buffer[ 256 ];
+	ssize_t n;
+
+	while( ( n = read( fd, buffer, sizeof( buffer ) ) ) > 0 )
+	{
+		ssize_t i;
+
+		for( i = 0; i < n; i++ )
+		{
+			uint8_t byte = buffer[ i ];
+
+			// wait for the start of a record
+			if( ( size == 0 && byte != TELEMETRY_SYNC0 ) || ( size == 1 && byte != TELEMETRY_SYNC1 )
+			    || ( size == 2 && byte != sizeof( telemetryRecord_t ) ) )
+			{
+				size = byte == TELEMETRY_SYNC0;
+				record[ 0 ] = byte;
+				continue;
+			}
+
+			record[ size++ ] = byte;
+
+			if( size < sizeof( record ) )
+			{
+				continue;
+			}
+
+			size = 0;
+
+			uint8_t sum = 0;
+			size_t j;
+
+			for( j = 0; j < sizeof( record ); j++ )
+			{
+				sum += record[ j ];
+			}
+
+			if( sum != 0 )
+			{
+				numErrors += 1;
+				continue;
+			}
+
+			// the records are little endian, like the PC
+			telemetryRecord_t r;
+			memcpy( &r, record, sizeof( r ) );
+
+			if( expectedSequence >= 0 )
+			{
+				numLost += (uint8_t) ( r.sequence - expectedSequence );
+			}
+			expectedSequence = (uint8_t) ( r.sequence + 1 );
+
+			numRecords += 1;
+			printRecord( &r );
+		}
+	}
+
+	fprintf( stderr, "%lu records, %lu corrupted, %lu lost\n", numRecords, numErrors, numLost );
+
+	return numRecords > 0 ? 0 : 1;
+}
@@ -0,0 +1,33 @@
+#ifndef USART_H_
+#define USART_H_
+
+// baud rate of the USART (8N1), shared by the telemetry (see telemetry.h) and the frame streaming
+// (see serial.h)
+#define USART_BAUD 38400
+
+// baud rate register value (rounded)
+#define USART_UBRR ( ( F_CPU + 8UL * USART_BAUD ) / ( 16UL * USART_BAUD ) - 1 )
+
+
+#ifdef __AVR__
+
+#include <avr/io.h>
+
+/**
+ * @brief Set up the baud rate and frame format of the USART
+ *
+ * The transmitter and receiver are enabled by their users.
+ */
+static inline void usartInit( void )
+{
+	UBRRH = USART_UBRR >> 8;
+	UBRRL = USART_UBRR & 0xff;
+
+	// 8 data bits, no parity, 1 stop bit
+	UCSRC = (1<<URSEL) | (1<<UCSZ1) | (1<<UCSZ0);
+}
+
+#endif
+
+
+#endif // USART_H_